@@ -4,30 +4,119 @@
 // ============================================================================
 
 #include "Sausage_Script.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 Codeloader::cSource* source = NULL;
+Codeloader::cSource_Pool* pool = NULL;
 
 bool Source_Process();
+bool Pool_Process();
 bool Process_Keys();
+void Run_Headless(std::string program, std::string signals);
+void Run_Headless_Program(Codeloader::cHeadless_IO& headless, std::string program, int options, bool slices);
+int Run_Tests();
+std::vector<std::string> Read_Expected_Calls(std::string name);
+void Run_Test_Program(Codeloader::cHeadless_IO& headless, std::string program, int options, bool slices);
+bool Check_Test_Calls(std::string name, Codeloader::cHeadless_IO& headless, std::vector<std::string>& expected);
+int Run_Cache_Test();
+void Run_Benchmarks(int count, char** programs);
+void Run_Matrix_Benchmark(int size);
+void Compile_Programs(int count, char** programs);
+void Run_Pool_Benchmark(std::string program, int instances);
+void Print_Fusions(Codeloader::cSource* program);
+void Run_Snapshot_Benchmark(std::string program, int frames);
+void Run_Replay(std::string program, std::string recording, std::string baseline);
+void Report_Frame_Times(std::vector<long long>& frame_nanos, std::string baseline);
 
 // **************************************************************************
 // Program Entry Point
 // **************************************************************************
 
 int main(int argc, char** argv) {
-  if (argc == 2) {
+  int status = 0;
+  if ((argc == 2) && (argv[1][0] != '-')) {
     std::string program = argv[1];
     try {
       Codeloader::cConfig config("Config");
       int width = config.Get_Property("width");
       int height = config.Get_Property("height");
-      Codeloader::cAllegro_IO allegro(program, width, height, 2, "Game");
+      Codeloader::cBatched_Allegro_IO allegro(program, width, height, 2, "Game");
+      allegro.Stream_Resources("Resources"); // Read while the script compiles and runs.
       int prgm_start = config.Get_Property("program");
-      source = new Codeloader::cSource(program, &allegro);
-      allegro.Load_Resources("Resources");
+      int options = 0;
+      if (config.Get_Property("left_to_right")) {
+        options |= Codeloader::eOPTION_LEFT_TO_RIGHT;
+      }
+      if (config.Get_Property("profile")) {
+        options |= Codeloader::eOPTION_PROFILE;
+      }
+      if (config.Get_Property("no_fuse")) {
+        options |= Codeloader::eOPTION_NO_FUSE;
+      }
+      if (config.Get_Property("retained")) {
+        options |= Codeloader::eOPTION_RETAINED;
+      }
+      int instances = config.Get_Property("instances");
+      if (instances > 0) { // Many copies of the program on a thread pool.
+        int threads = config.Get_Property("threads");
+        int steps = config.Get_Property("pool_steps");
+        pool = new Codeloader::cSource_Pool(&allegro, (threads > 0) ? threads : (int)std::thread::hardware_concurrency(), (steps > 0) ? steps : 1000);
+        for (int instance = 0; instance < instances; instance++) {
+          pool->Add(program, options);
+        }
+      }
+      else {
+        source = new Codeloader::cSource(program, &allegro, options);
+        if (config.Get_Property("seed")) {
+          source->random_seed = config.Get_Property("seed");
+        }
+        if (config.Get_Property("record")) { // Replay with -replay.
+          source->Record_Signals();
+        }
+      }
       allegro.Load_Button_Names("Button_Names");
       allegro.Load_Button_Map("Buttons");
-      allegro.Process_Messages(Source_Process, Process_Keys);
+      allegro.Process_Messages(pool ? Pool_Process : Source_Process, Process_Keys);
+      if (source && (source->signal_mode == Codeloader::eSIGNALS_RECORD)) {
+        source->Save_Signals(program + ".replay");
+      }
+      if (source && config.Get_Property("run_stats")) {
+        Codeloader::sRun_Stats& stats = source->run_stats;
+        int frames = std::max(stats.frames, 1);
+        std::cout << "Frames: " << stats.frames << std::endl;
+        std::cout << "Instructions/Frame: " << (stats.instructions / frames) << std::endl;
+        std::cout << "Budget: " << stats.budget << std::endl;
+        std::cout << "Overruns: " << stats.overruns << " (max " << stats.max_overrun << " us)" << std::endl;
+        Codeloader::sDraw_Stats& draws = source->draw_stats;
+        int draw_frames = std::max(draws.frames, 1);
+        std::cout << "Draw Calls/Frame: " << (draws.draw_calls / draw_frames) << std::endl;
+        std::cout << "Batches/Frame: " << (draws.batches / draw_frames) << std::endl;
+        std::cout << "Skipped Frames: " << draws.skipped_frames << std::endl;
+        std::cout << "Partial Frames: " << draws.partial_frames << std::endl;
+        Codeloader::sText_Stats& texts = allegro.text_stats;
+        std::cout << "Text Runs: " << texts.run_hits << " hits, " << texts.run_misses << " misses" << std::endl;
+        std::cout << "Digit Atlas: " << texts.digit_hits << " hits, " << texts.digit_misses << " misses" << std::endl;
+        Print_Fusions(source);
+      }
+      if (source && source->profiler) {
+        source->profiler->Write(program);
+      }
+      if (pool) {
+        int pool_count = (int)pool->sources.size();
+        for (int instance = 0; instance < pool_count; instance++) {
+          if (pool->sources[instance]->profiler) {
+            pool->sources[instance]->profiler->Write(program + pool->sources[instance]->file_suffix);
+          }
+        }
+      }
     }
     catch (Codeloader::cError error) {
       error.Print();
@@ -35,12 +124,47 @@ int main(int argc, char** argv) {
     if (source) {
       delete source;
     }
+    if (pool) {
+      delete pool;
+    }
+  }
+  else if ((argc >= 3) && (std::string(argv[1]) == "-headless")) {
+    Run_Headless(argv[2], (argc == 4) ? argv[3] : "");
+  }
+  else if ((argc == 2) && (std::string(argv[1]) == "-test")) {
+    status = (Run_Tests() > 0) ? 1 : 0;
+  }
+  else if ((argc >= 3) && (std::string(argv[1]) == "-compile")) {
+    Compile_Programs(argc - 2, argv + 2);
+  }
+  else if ((argc == 4) && (std::string(argv[1]) == "-bench-pool")) {
+    Run_Pool_Benchmark(argv[2], Codeloader::Text_To_Number(argv[3]));
+  }
+  else if ((argc >= 4) && (std::string(argv[1]) == "-replay")) {
+    Run_Replay(argv[2], argv[3], (argc == 5) ? argv[4] : "");
+  }
+  else if ((argc >= 3) && (std::string(argv[1]) == "-bench-snapshot")) {
+    Run_Snapshot_Benchmark(argv[2], (argc == 4) ? Codeloader::Text_To_Number(argv[3]) : 1000);
+  }
+  else if ((argc >= 2) && (std::string(argv[1]) == "-bench-matrix")) {
+    Run_Matrix_Benchmark((argc == 3) ? Codeloader::Text_To_Number(argv[2]) : 1024);
+  }
+  else if ((argc >= 2) && (std::string(argv[1]) == "-bench")) {
+    Run_Benchmarks(argc - 2, argv + 2);
   }
   else {
     std::cout << "Usage: " << argv[0] << " <program>" << std::endl;
+    std::cout << "       " << argv[0] << " -headless <program> [<signals>]" << std::endl;
+    std::cout << "       " << argv[0] << " -test" << std::endl;
+    std::cout << "       " << argv[0] << " -bench [<program> ...]" << std::endl;
+    std::cout << "       " << argv[0] << " -bench-matrix [<size>]" << std::endl;
+    std::cout << "       " << argv[0] << " -compile <program> ..." << std::endl;
+    std::cout << "       " << argv[0] << " -bench-pool <program> <instances>" << std::endl;
+    std::cout << "       " << argv[0] << " -bench-snapshot <program> [<frames>]" << std::endl;
+    std::cout << "       " << argv[0] << " -replay <program> <recording> [<baseline>]" << std::endl;
   }
   std::cout << "Done." << std::endl;
-  return 0;
+  return status;
 }
 
 // ****************************************************************************
@@ -56,6 +180,15 @@ bool Source_Process() {
   return false;
 }
 
+/**
+ * Called when the pooled scripts need to be processed.
+ * @return True if the app needs to exit, false otherwise.
+ */
+bool Pool_Process() {
+  pool->Run_Frame();
+  return false;
+}
+
 /**
  * Called when keys are processed.
  * @return True if the app needs to exit, false otherwise.
@@ -64,48 +197,1189 @@ bool Process_Keys() {
   return false;
 }
 
+// ****************************************************************************
+// Script Compiler
+// ****************************************************************************
+
+/**
+ * Compiles programs ahead of time so their caches ship with them.
+ * @param count The number of programs.
+ * @param programs The names of the programs.
+ */
+void Compile_Programs(int count, char** programs) {
+  int options = 0;
+  try {
+    Codeloader::cConfig config("Config");
+    if (config.Get_Property("left_to_right")) {
+      options |= Codeloader::eOPTION_LEFT_TO_RIGHT;
+    }
+    if (config.Get_Property("no_fuse")) {
+      options |= Codeloader::eOPTION_NO_FUSE;
+    }
+  }
+  catch (Codeloader::cError error) {
+    error.Print();
+  }
+  for (int program_index = 0; program_index < count; program_index++) {
+    std::string program = programs[program_index];
+    try {
+      Codeloader::cHeadless_IO headless(false);
+      Codeloader::cSource compiled(program, &headless, options);
+      std::cout << "Compiled " << program << " to " << program << ".ssc" << std::endl;
+      Print_Fusions(&compiled);
+    }
+    catch (Codeloader::cError error) {
+      error.Print();
+    }
+  }
+}
+
+/**
+ * Prints how many statements of a program were fused into single opcodes.
+ * @param program The compiled program.
+ */
+void Print_Fusions(Codeloader::cSource* program) {
+  Codeloader::sFuse_Stats fusions = program->Count_Fusions();
+  std::cout << "Fused Steps: " << fusions.steps << std::endl;
+  std::cout << "Fused If Tests: " << fusions.if_tests << std::endl;
+  std::cout << "Fused Loop Tests: " << fusions.loop_tests << std::endl;
+}
+
+// ****************************************************************************
+// Pool Benchmark
+// ****************************************************************************
+
+/**
+ * Runs many copies of a program on one thread and then on every core and
+ * reports the speed of each.
+ * @param program The name of the program.
+ * @param instances The number of copies.
+ */
+void Run_Pool_Benchmark(std::string program, int instances) {
+  int thread_counts[] = { 1, std::max((int)std::thread::hardware_concurrency(), 1) };
+  for (int run = 0; run < 2; run++) {
+    try {
+      Codeloader::cHeadless_IO headless(false);
+      Codeloader::cSource_Pool bench_pool(&headless, thread_counts[run], 1000);
+      for (int instance = 0; instance < instances; instance++) {
+        bench_pool.Add(program, 0);
+      }
+      auto start = std::chrono::steady_clock::now();
+      int frames = 0;
+      while (!bench_pool.Is_Done()) {
+        bench_pool.Run_Frame();
+        frames++;
+      }
+      auto end = std::chrono::steady_clock::now();
+      double nanos = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+      long long instrs = 0;
+      for (int instance = 0; instance < instances; instance++) {
+        instrs += bench_pool.sources[instance]->run_stats.instructions;
+      }
+      std::cout << thread_counts[run] << " thread(s): " << instances << " scripts, " << frames << " frames, " <<
+        (long long)((double)instrs * 1e9 / std::max(nanos, 1.0)) << " instrs/sec" << std::endl;
+    }
+    catch (Codeloader::cError error) {
+      error.Print();
+    }
+  }
+}
+
+// ****************************************************************************
+// Replay Benchmark
+// ****************************************************************************
+
+/**
+ * Replays a recorded session without a window and reports how long the
+ * frames took, from one refresh to the next. Waits are skipped since they
+ * only pass time.
+ * @param program The name of the program.
+ * @param recording The name of the recording.
+ * @param baseline The name of the baseline or an empty string.
+ */
+void Run_Replay(std::string program, std::string recording, std::string baseline) {
+  Codeloader::cHeadless_IO headless(false);
+  try {
+    Codeloader::cConfig config("Config");
+    int options = 0;
+    if (config.Get_Property("left_to_right")) {
+      options |= Codeloader::eOPTION_LEFT_TO_RIGHT;
+    }
+    if (config.Get_Property("no_fuse")) {
+      options |= Codeloader::eOPTION_NO_FUSE;
+    }
+    if (config.Get_Property("retained")) {
+      options |= Codeloader::eOPTION_RETAINED;
+    }
+    source = new Codeloader::cSource(program, &headless, options);
+    if (!source->Replay_Signals(recording)) {
+      throw Codeloader::cError("Recording " + recording + " could not be read.");
+    }
+    std::vector<long long> frame_nanos;
+    int frame = source->draw_stats.frames;
+    auto frame_start = std::chrono::steady_clock::now();
+    while ((source->status != Codeloader::eSTATUS_DONE) && (source->draw_stats.frames < source->log_frames)) {
+      if ((source->Get_Sleep_Time() == -1) && (source->Next_Signal_Frame() != source->draw_stats.frames)) {
+        std::cout << "Waiting for input the recording does not have." << std::endl;
+        break;
+      }
+      source->wake_time = std::chrono::steady_clock::now();
+      source->Run_Steps(1); // A slice may hold many refreshes, so check after each statement.
+      if (source->draw_stats.frames != frame) {
+        auto frame_end = std::chrono::steady_clock::now();
+        frame_nanos.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(frame_end - frame_start).count());
+        frame = source->draw_stats.frames;
+        frame_start = frame_end;
+      }
+    }
+    Report_Frame_Times(frame_nanos, baseline);
+  }
+  catch (Codeloader::cError error) {
+    error.Print();
+  }
+  if (source) {
+    delete source;
+    source = NULL;
+  }
+}
+
+/**
+ * Prints frame time percentiles and compares them with a baseline. A
+ * missing baseline is written from this run.
+ * @param frame_nanos The time of each frame in nanoseconds.
+ * @param baseline The name of the baseline or an empty string.
+ */
+void Report_Frame_Times(std::vector<long long>& frame_nanos, std::string baseline) {
+  static const char* names[] = { "p50", "p90", "p99", "max" };
+  static const int percents[] = { 50, 90, 99, 100 };
+  const int tolerance = 10; // Percent slower before a frame time is flagged.
+  int frame_count = frame_nanos.size();
+  if (frame_count == 0) {
+    std::cout << "No frames were run." << std::endl;
+    return;
+  }
+  std::sort(frame_nanos.begin(), frame_nanos.end());
+  std::cout << "Frames: " << frame_count << std::endl;
+  long long times[4];
+  for (int time_index = 0; time_index < 4; time_index++) {
+    times[time_index] = frame_nanos[std::min((frame_count * percents[time_index]) / 100, frame_count - 1)];
+    std::cout << names[time_index] << ": " << (times[time_index] / 1000.0) << " us" << std::endl;
+  }
+  if (baseline.length() == 0) {
+    return;
+  }
+  std::ifstream baseline_in(baseline.c_str());
+  if (!baseline_in) {
+    std::ofstream baseline_out(baseline.c_str());
+    for (int time_index = 0; time_index < 4; time_index++) {
+      baseline_out << names[time_index] << " " << times[time_index] << std::endl;
+    }
+    std::cout << "Saved baseline to " << baseline << "." << std::endl;
+    return;
+  }
+  int regressions = 0;
+  std::string name;
+  long long base_time = 0; // In nanoseconds.
+  for (int time_index = 0; (time_index < 4) && (baseline_in >> name >> base_time); time_index++) {
+    if (times[time_index] * 100 > base_time * (100 + tolerance)) {
+      std::cout << "REGRESSION " << name << ": " << (times[time_index] / 1000.0) << " us against " << (base_time / 1000.0) << " us" << std::endl;
+      regressions++;
+    }
+  }
+  if (regressions == 0) {
+    std::cout << "No regressions against " << baseline << "." << std::endl;
+  }
+}
+
+// ****************************************************************************
+// Snapshot Benchmark
+// ****************************************************************************
+
+/**
+ * Takes an incremental snapshot of a program after every frame, then
+ * restores them in order into a second copy and checks that both end up
+ * in the same state.
+ * @param program The name of the program.
+ * @param frames The most frames to run.
+ */
+void Run_Snapshot_Benchmark(std::string program, int frames) {
+  try {
+    Codeloader::cHeadless_IO headless(false);
+    Codeloader::cSource running(program, &headless, 0);
+    std::vector<std::string> snapshots;
+    double save_nanos = 0;
+    long long bytes = 0;
+    for (int frame = 0; (frame < frames) && (running.status != Codeloader::eSTATUS_DONE); frame++) {
+      running.Run_Steps(1000);
+      std::ostringstream snapshot;
+      auto start = std::chrono::steady_clock::now();
+      running.Save_Snapshot(snapshot, true);
+      auto end = std::chrono::steady_clock::now();
+      save_nanos += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+      snapshots.push_back(snapshot.str());
+      bytes += snapshots.back().length();
+    }
+    Codeloader::cSource restored(program, &headless, 0);
+    int snapshot_count = snapshots.size();
+    bool loaded = true;
+    auto start = std::chrono::steady_clock::now();
+    for (int snapshot_index = 0; snapshot_index < snapshot_count; snapshot_index++) {
+      std::istringstream snapshot(snapshots[snapshot_index]);
+      loaded = restored.Load_Snapshot(snapshot) && loaded;
+    }
+    auto end = std::chrono::steady_clock::now();
+    double load_nanos = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    bool same = loaded && (restored.pointer == running.pointer) && (restored.vars == running.vars) &&
+      (restored.lists == running.lists) && (restored.strings == running.strings);
+    int matrix_count = running.matrices.size();
+    for (int matrix_index = 0; same && (matrix_index < matrix_count); matrix_index++) {
+      Codeloader::cFlat_Matrix& left = running.matrices[matrix_index];
+      Codeloader::cFlat_Matrix& right = restored.matrices[matrix_index];
+      same = (left.width == right.width) && (left.height == right.height) &&
+        std::equal(left.cells, left.cells + left.Count(), right.cells);
+    }
+    int count = std::max(snapshot_count, 1);
+    std::cout << program << ": " << snapshot_count << " snapshots, " << (bytes / count) << " bytes/snapshot, " <<
+      (save_nanos / count / 1000.0) << " us/save, " << (load_nanos / count / 1000.0) << " us/restore, " <<
+      (same ? "restored state matches" : "restored state DIFFERS") << std::endl;
+  }
+  catch (Codeloader::cError error) {
+    error.Print();
+  }
+}
+
+// ****************************************************************************
+// Matrix Benchmark
+// ****************************************************************************
+
+/**
+ * Times a sweep over a matrix.
+ * @param name The name of the sweep.
+ * @param cells The number of cells visited.
+ * @param sweep The sweep. Returns a checksum so it is not optimized away.
+ */
+template <typename tSweep>
+void Time_Sweep(std::string name, double cells, tSweep sweep) {
+  auto start = std::chrono::steady_clock::now();
+  int checksum = sweep();
+  auto end = std::chrono::steady_clock::now();
+  double nanos = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  std::cout << name << ": " << (nanos / cells) << " ns/cell (checksum " << checksum << ")" << std::endl;
+}
+
+/**
+ * Compares the I/O matrix with the flat matrix used by the interpreter on
+ * row and column sweeps of a large map.
+ * @param size The width and height of the map.
+ */
+void Run_Matrix_Benchmark(int size) {
+  const int passes = 4;
+  double cells = (double)size * size * passes;
+  Codeloader::cMatrix matrix(size, size);
+  Codeloader::cFlat_Matrix flat(size, size);
+  Time_Sweep("cMatrix rows", cells, [&]() {
+    int sum = 0;
+    for (int pass = 0; pass < passes; pass++) {
+      for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+          matrix[y][x] += x ^ y;
+          sum += matrix[y][x];
+        }
+      }
+    }
+    return sum;
+  });
+  Time_Sweep("cFlat_Matrix rows", cells, [&]() {
+    int sum = 0;
+    for (int pass = 0; pass < passes; pass++) {
+      for (int y = 0; y < size; y++) {
+        int* row = flat[y];
+        for (int x = 0; x < size; x++) {
+          row[x] += x ^ y;
+          sum += row[x];
+        }
+      }
+    }
+    return sum;
+  });
+  Time_Sweep("cMatrix columns", cells, [&]() {
+    int sum = 0;
+    for (int pass = 0; pass < passes; pass++) {
+      for (int x = 0; x < size; x++) {
+        for (int y = 0; y < size; y++) {
+          sum += matrix[y][x];
+        }
+      }
+    }
+    return sum;
+  });
+  Time_Sweep("cFlat_Matrix columns", cells, [&]() {
+    int sum = 0;
+    for (int pass = 0; pass < passes; pass++) {
+      for (int x = 0; x < size; x++) {
+        int* cell = flat[0] + x;
+        for (int y = 0; y < size; y++) {
+          sum += *cell;
+          cell += size;
+        }
+      }
+    }
+    return sum;
+  });
+  Time_Sweep("cMatrix fill and sum", cells, [&]() {
+    int sum = 0;
+    for (int pass = 0; pass < passes; pass++) {
+      for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+          matrix[y][x] = pass;
+        }
+      }
+      for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+          sum += matrix[y][x];
+        }
+      }
+    }
+    return sum;
+  });
+  Time_Sweep("cFlat_Matrix fill and sum", cells, [&]() {
+    int sum = 0;
+    for (int pass = 0; pass < passes; pass++) {
+      Codeloader::Fill_Values(flat.cells, flat.Count(), pass);
+      sum += Codeloader::Sum_Values(flat.cells, flat.Count());
+    }
+    return sum;
+  });
+}
+
+// ****************************************************************************
+// Headless Runner
+// ****************************************************************************
+
+/**
+ * Runs a program without a window and prints the calls it made.
+ * @param program The name of the program.
+ * @param signals The name of the signal script or an empty string.
+ */
+void Run_Headless(std::string program, std::string signals) {
+  Codeloader::cHeadless_IO headless(true);
+  try {
+    Codeloader::cConfig config("Config");
+    int options = config.Get_Property("profile") ? Codeloader::eOPTION_PROFILE : 0;
+    if (config.Get_Property("left_to_right")) {
+      options |= Codeloader::eOPTION_LEFT_TO_RIGHT;
+    }
+    if (config.Get_Property("no_fuse")) {
+      options |= Codeloader::eOPTION_NO_FUSE;
+    }
+    if (config.Get_Property("retained")) {
+      options |= Codeloader::eOPTION_RETAINED;
+    }
+    if (signals.length() > 0) {
+      headless.Load_Signals(signals);
+    }
+    Run_Headless_Program(headless, program, options, false);
+    if (source->profiler) {
+      source->profiler->Write(program);
+    }
+  }
+  catch (Codeloader::cError error) {
+    error.Print();
+  }
+  int call_count = headless.calls.Count();
+  for (int call_index = 0; call_index < call_count; call_index++) {
+    std::cout << headless.calls[call_index] << std::endl;
+  }
+  if (source) {
+    delete source;
+    source = NULL;
+  }
+}
+
+/**
+ * Runs a program to the end, or until it waits for input which will never
+ * come. The program is left in the global source.
+ * @param headless The headless I/O control with any signals loaded.
+ * @param program The name of the program.
+ * @param options The options of the program.
+ * @param slices Records "slice" before each slice the host runs.
+ * @throws An error if the program could not be compiled or run.
+ */
+void Run_Headless_Program(Codeloader::cHeadless_IO& headless, std::string program, int options, bool slices) {
+  source = new Codeloader::cSource(program, &headless, options);
+  while (source->status != Codeloader::eSTATUS_DONE) {
+    if (slices) {
+      headless.Record("slice");
+    }
+    source->Run(20);
+    int sleep = source->Get_Sleep_Time();
+    if ((sleep == -1) && !headless.Has_Signals()) {
+      std::cout << "Waiting for input with no signals left." << std::endl;
+      break;
+    }
+    if (sleep > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(sleep));
+    }
+  }
+}
+
+/**
+ * Runs each golden test headless, with and without fused opcodes, and
+ * compares the calls made with the expected calls. An error which stops a
+ * test is compared as the lines that follow its calls. Run from the folder
+ * holding the Tests folder.
+ * @return The number of failed runs.
+ */
+int Run_Tests() {
+  static const Codeloader::sGolden_Test tests[] = {
+    { "Tests/Precedence", "", "Tests/Precedence.txt", 0, false },
+    { "Tests/Precedence", "", "Tests/Left_To_Right.txt", Codeloader::eOPTION_LEFT_TO_RIGHT, false },
+    { "Tests/Control_Flow", "", "Tests/Control_Flow.txt", 0, false },
+    { "Tests/Short_Circuit", "", "Tests/Short_Circuit.txt", 0, false },
+    { "Tests/Numbers", "", "Tests/Numbers.txt", 0, false },
+    { "Tests/Number_Range", "", "Tests/Number_Range.txt", 0, false },
+    { "Tests/Random", "", "Tests/Random.txt", 0, false },
+    { "Tests/Subroutines", "", "Tests/Subroutines.txt", 0, false },
+    { "Tests/Accessors", "", "Tests/Accessors.txt", 0, false },
+    { "Tests/Fused_Loops", "", "Tests/Fused_Loops.txt", 0, false },
+    { "Tests/Draw_Order", "", "Tests/Draw_Order.txt", 0, false },
+    { "Tests/Retained", "", "Tests/Retained.txt", Codeloader::eOPTION_RETAINED, false },
+    { "Tests/Snapshot", "Tests/Snapshot_Signals.txt", "Tests/Snapshot.txt", 0, false },
+    { "Tests/Bulk", "", "Tests/Bulk.txt", 0, false },
+    { "Tests/Collide", "", "Tests/Collide.txt", 0, false },
+    { "Tests/Binary_Map", "", "Tests/Binary_Map.txt", 0, false },
+    { "Tests/Empty_Map", "", "Tests/Empty_Map.txt", 0, false },
+    { "Tests/Suspend", "Tests/Suspend_Signals.txt", "Tests/Suspend.txt", 0, true }
+  };
+  int test_count = sizeof(tests) / sizeof(tests[0]);
+  int run_count = test_count * 2;
+  int failures = 0;
+  for (int run_index = 0; run_index < run_count; run_index++) {
+    const Codeloader::sGolden_Test& test = tests[run_index / 2];
+    bool fused = ((run_index % 2) == 0);
+    std::string name = std::string(test.expected) + (fused ? "" : " (no fuse)");
+    Codeloader::cHeadless_IO headless(true);
+    bool passed = false;
+    try {
+      std::vector<std::string> expected = Read_Expected_Calls(test.expected);
+      if (std::string(test.signals).length() > 0) {
+        headless.Load_Signals(test.signals);
+      }
+      Run_Test_Program(headless, test.program, test.options | (fused ? 0 : Codeloader::eOPTION_NO_FUSE), test.slices);
+      passed = Check_Test_Calls(name, headless, expected);
+    }
+    catch (Codeloader::cError error) {
+      std::cout << name << ": ";
+      error.Print();
+      std::cout << std::endl;
+    }
+    if (source) {
+      delete source;
+      source = NULL;
+    }
+    if (!passed) {
+      failures++;
+    }
+  }
+  failures += Run_Cache_Test();
+  run_count += Codeloader::eCACHE_TEST_RUNS;
+  std::cout << failures << " of " << run_count << " test runs failed." << std::endl;
+  return failures;
+}
+
+/**
+ * Reads the calls a test is expected to make, one per line.
+ * @param name The name of the file of expected calls.
+ * @return The expected calls.
+ * @throws An error if the file could not be read.
+ */
+std::vector<std::string> Read_Expected_Calls(std::string name) {
+  std::vector<std::string> expected;
+  Codeloader::cFile expected_file(name);
+  expected_file.Read();
+  while (!expected_file.Has_More_Lines()) {
+    std::string line = expected_file.Get_Line();
+    if (line.length() > 0) {
+      expected.push_back(line);
+    }
+  }
+  return expected;
+}
+
+/**
+ * Runs a test program to the end, leaving it in the global source. An
+ * error which stops the program is kept with its calls, one line per line
+ * of the message.
+ * @param headless The headless I/O control which records the calls.
+ * @param program The name of the program.
+ * @param options The options of the program.
+ * @param slices Records "slice" before each slice the host runs.
+ */
+void Run_Test_Program(Codeloader::cHeadless_IO& headless, std::string program, int options, bool slices) {
+  try {
+    Run_Headless_Program(headless, program, options, slices);
+  }
+  catch (Codeloader::cError error) {
+    std::ostringstream message;
+    std::streambuf* output = std::cout.rdbuf(message.rdbuf());
+    error.Print();
+    std::cout.rdbuf(output);
+    std::istringstream lines(message.str());
+    std::string line;
+    while (std::getline(lines, line)) {
+      headless.calls.Add(line);
+    }
+  }
+}
+
+/**
+ * Compares the calls of a test run with the expected calls and reports
+ * the result, or the first line which differs.
+ * @param name The name of the test run.
+ * @param headless The headless I/O control which recorded the calls.
+ * @param expected The expected calls.
+ * @return True if the calls match, false otherwise.
+ */
+bool Check_Test_Calls(std::string name, Codeloader::cHeadless_IO& headless, std::vector<std::string>& expected) {
+  int call_count = headless.calls.Count();
+  int line_count = expected.size();
+  int line_index = 0;
+  while ((line_index < call_count) && (line_index < line_count) && (headless.calls[line_index] == expected[line_index])) {
+    line_index++;
+  }
+  bool passed = (line_index == call_count) && (line_index == line_count);
+  if (passed) {
+    std::cout << name << ": passed" << std::endl;
+  }
+  else {
+    std::cout << name << ": line " << (line_index + 1) << " expected \"" <<
+      ((line_index < line_count) ? expected[line_index] : "<end>") << "\" but got \"" <<
+      ((line_index < call_count) ? headless.calls[line_index] : "<end>") << "\"" << std::endl;
+  }
+  return passed;
+}
+
+/**
+ * Runs a copy of the cache test program several times. It is compiled,
+ * then loaded from its cache, then compiled again after an option and
+ * then its text change. Each run must make the expected calls and only
+ * use the cache when neither has changed.
+ * @return The number of failed runs.
+ */
+int Run_Cache_Test() {
+  static const char* steps[Codeloader::eCACHE_TEST_RUNS] = {
+    "compiled", "cached", "no_fuse compiled", "no_fuse cached", "edited compiled"
+  };
+  static const bool cached[Codeloader::eCACHE_TEST_RUNS] = { false, true, false, true, false };
+  static const int options[Codeloader::eCACHE_TEST_RUNS] = { 0, 0, Codeloader::eOPTION_NO_FUSE, Codeloader::eOPTION_NO_FUSE, Codeloader::eOPTION_NO_FUSE };
+  std::string program = "Tests/Cache_Copy";
+  int failures = 0;
+  try {
+    std::vector<std::string> expected = Read_Expected_Calls("Tests/Cache.txt");
+    std::string text;
+    if (!Codeloader::Read_Text_File("Tests/Cache.ss", text)) {
+      throw Codeloader::cError("Could not read Tests/Cache.ss.");
+    }
+    std::remove((program + ".ssc").c_str());
+    for (int step = 0; step < Codeloader::eCACHE_TEST_RUNS; step++) {
+      if ((step == 0) || (step == (Codeloader::eCACHE_TEST_RUNS - 1))) {
+        std::ofstream copy((program + ".ss").c_str(), std::ios::binary | std::ios::trunc);
+        copy << text << ((step == 0) ? "" : "Edited.\r\n"); // A comment changes the text but not the code.
+      }
+      std::string name = std::string("Tests/Cache.txt (") + steps[step] + ")";
+      Codeloader::cHeadless_IO headless(true);
+      Run_Test_Program(headless, program, options[step], false);
+      bool from_cache = source && source->from_cache;
+      if (source) {
+        delete source;
+        source = NULL;
+      }
+      if (from_cache != cached[step]) {
+        std::cout << name << ": " << (from_cache ? "used" : "did not use") << " the cache" << std::endl;
+        failures++;
+      }
+      else if (!Check_Test_Calls(name, headless, expected)) {
+        failures++;
+      }
+    }
+  }
+  catch (Codeloader::cError error) {
+    std::cout << "Tests/Cache.txt: ";
+    error.Print();
+    std::cout << std::endl;
+    failures = Codeloader::eCACHE_TEST_RUNS;
+  }
+  return failures;
+}
+
+/**
+ * Runs each program in the benchmark corpus and reports its speed.
+ * @param count The number of programs given or zero for the corpus.
+ * @param programs The names of the programs.
+ */
+void Run_Benchmarks(int count, char** programs) {
+  static const char* corpus[] = {
+    "Benchmarks/Loops",
+    "Benchmarks/Matrix_Sweep",
+    "Benchmarks/Subroutines",
+    "Benchmarks/Expressions",
+    "Benchmarks/Bulk",
+    "Benchmarks/Collide"
+  };
+  bool use_corpus = (count == 0);
+  if (use_corpus) {
+    count = sizeof(corpus) / sizeof(corpus[0]);
+  }
+  for (int bench_index = 0; bench_index < count; bench_index++) {
+    std::string program = use_corpus ? corpus[bench_index] : programs[bench_index];
+    try {
+      Codeloader::cHeadless_IO headless(false);
+      source = new Codeloader::cSource(program, &headless, 0);
+      auto start = std::chrono::steady_clock::now();
+      while (source->status != Codeloader::eSTATUS_DONE) {
+        source->Run(20);
+      }
+      auto end = std::chrono::steady_clock::now();
+      double nanos = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+      double instrs = (double)std::max(source->run_stats.instructions, 1LL);
+      std::cout << program << ": " << source->run_stats.instructions << " instrs, " <<
+        (long long)(instrs * 1e9 / std::max(nanos, 1.0)) << " instrs/sec, " <<
+        (nanos / instrs) << " ns/op" << std::endl;
+    }
+    catch (Codeloader::cError error) {
+      std::cout << program << ": ";
+      error.Print();
+    }
+    if (source) {
+      delete source;
+      source = NULL;
+    }
+  }
+}
+
 namespace Codeloader {
 
   // **************************************************************************
-  // Source Implementation
+  // Opcode Table
+  // **************************************************************************
+
+  // Must follow the order of eOpcode.
+  static const sOpcode_Info opcode_infos[eOPCODE_COUNT] = {
+    { "push const", 1 },
+    { "push var", 1 },
+    { "push list", 2 },
+    { "push matrix", 3 },
+    { "getkey", 0 },
+    { "+", 0 },
+    { "-", 0 },
+    { "*", 0 },
+    { "/", 0 },
+    { "rem", 0 },
+    { "rand", 0 },
+    { "cos", 0 },
+    { "sin", 0 },
+    { "=", 0 },
+    { "not", 0 },
+    { ">", 0 },
+    { "<", 0 },
+    { ">or=", 0 },
+    { "<or=", 0 },
+    { "and", 1 },
+    { "or", 1 },
+    { "if", 1 },
+    { "else", 1 },
+    { "end", 0 },
+    { "while", 2 },
+    { "subroutine", 2 },
+    { "call", 1 },
+    { "store var", 1 },
+    { "store list", 2 },
+    { "store matrix", 3 },
+    { "output", 1 },
+    { "number", 1 },
+    { "define", 2 },
+    { "var", 1 },
+    { "list", 1 },
+    { "matrix", 1 },
+    { "string", 2 },
+    { "load", 2 },
+    { "load window", 2 },
+    { "save", 2 },
+    { "draw", 1 },
+    { "sound", 1 },
+    { "music", 1 },
+    { "silence", 0 },
+    { "refresh", 0 },
+    { "color", 0 },
+    { "stop", 0 },
+    { "fill", 2 },
+    { "copy", 3 },
+    { "blit", 2 },
+    { "add", 2 },
+    { "multiply", 2 },
+    { "sum", 2 },
+    { "minimum", 2 },
+    { "maximum", 2 },
+    { "yield", 0 },
+    { "wait", 0 },
+    { "waitkey", 0 },
+    { "progress", 0 },
+    { "step", 2 },
+    { "if const", 4 },
+    { "while const", 5 },
+    { "while vars", 5 },
+    { "snapshot", 1 },
+    { "restore", 1 },
+    { "collide", 3 },
+    { "nearest", 3 },
+    { "exit", 0 }
+  };
+
+  // Words with a fixed meaning to the compiler.
+  static const char* keywords[] = {
+    "if", "then", "else", "end", "while", "do", "subroutine", "call", "store",
+    "in", "output", "number", "at", "color", "define", "as", "object", "map",
+    "var", "list", "size", "matrix", "string", "load", "from", "save", "to",
+    "draw", "angle", "flip", "sound", "music", "silence", "refresh", "getkey",
+    "stop", "fill", "with", "copy", "blit", "add", "multiply", "by", "sum",
+    "minimum", "maximum", "yield", "wait", "waitkey", "progress",
+    "snapshot", "restore", "collide", "nearest", "within"
+  };
+
+  // **************************************************************************
+  // Bulk Operations
   // **************************************************************************
 
   /**
-   * Creates a new source module.
-   * @param source The source code name.
-   * @param io The I/O control.
+   * Sets every value in a row.
+   * @param values The row.
+   * @param count The number of values.
+   * @param value The value to set.
    */
-  cSource::cSource(std::string source, cIO_Control* io) {
-    this->pointer = 0;
-    this->io = io;
-    this->status = eSTATUS_IDLE;
-    this->Parse_Tokens(source);
-    this->status = eSTATUS_RUNNING;
+  void Fill_Values(int* values, int count, int value) {
+    for (int value_index = 0; value_index < count; value_index++) {
+      values[value_index] = value;
+    }
   }
 
   /**
-   * Parses tokens from a source file.
-   * @param source The name of the source code.
-   * @throws An error if something went wrong.
+   * Adds a value to every value in a row.
+   * @param values The row.
+   * @param count The number of values.
+   * @param value The value to add.
    */
-  void cSource::Parse_Tokens(std::string source) {
-    cFile source_file(source + ".ss");
-    source_file.Read();
-    int line_no = 0;
-    while (!source_file.Has_More_Lines()) {
-      std::string line = source_file.Get_Line();
-      line_no++;
-      if (line.length() > 0) {
-        if (line[0] == ':') { // Code line.
-          line = line.substr(1);
-          // Parse the tokens.
-          cArray<std::string> tokens = Parse_C_Lesh_Line(line);
-          int tok_count = tokens.Count();
+  void Add_Values(int* values, int count, int value) {
+    for (int value_index = 0; value_index < count; value_index++) {
+      values[value_index] += value;
+    }
+  }
+
+  /**
+   * Multiplies every value in a row.
+   * @param values The row.
+   * @param count The number of values.
+   * @param value The value to multiply by.
+   */
+  void Multiply_Values(int* values, int count, int value) {
+    for (int value_index = 0; value_index < count; value_index++) {
+      values[value_index] *= value;
+    }
+  }
+
+  /**
+   * Sums a row.
+   * @param values The row.
+   * @param count The number of values.
+   * @return The sum.
+   */
+  int Sum_Values(const int* values, int count) {
+    unsigned int sum = 0; // Wraps like the add operator.
+    for (int value_index = 0; value_index < count; value_index++) {
+      sum += (unsigned int)values[value_index];
+    }
+    return (int)sum;
+  }
+
+  /**
+   * Finds the least value in a row.
+   * @param values The row.
+   * @param count The number of values.
+   * @param least The least value so far.
+   * @return The least value.
+   */
+  int Minimum_Value(const int* values, int count, int least) {
+    for (int value_index = 0; value_index < count; value_index++) {
+      least = (values[value_index] < least) ? values[value_index] : least;
+    }
+    return least;
+  }
+
+  /**
+   * Finds the greatest value in a row.
+   * @param values The row.
+   * @param count The number of values.
+   * @param greatest The greatest value so far.
+   * @return The greatest value.
+   */
+  int Maximum_Value(const int* values, int count, int greatest) {
+    for (int value_index = 0; value_index < count; value_index++) {
+      greatest = (values[value_index] > greatest) ? values[value_index] : greatest;
+    }
+    return greatest;
+  }
+
+  // **************************************************************************
+  // Cache Files
+  // **************************************************************************
+
+  /**
+   * Reads a whole file as it is.
+   * @param name The name of the file.
+   * @param text Receives the contents.
+   * @return True if the file could be read.
+   */
+  bool Read_Text_File(std::string name, std::string& text) {
+    std::ifstream file(name.c_str(), std::ios::binary);
+    if (!file) {
+      return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    text = contents.str();
+    return true;
+  }
+
+  /**
+   * Compares two values with a test the same way the test opcodes do.
+   * @param test The opcode of the test.
+   * @param left The left value.
+   * @param right The right value.
+   * @return The result of the test.
+   */
+  bool Compare_Values(int test, int left, int right) {
+    int diff = (left - right);
+    bool result = false;
+    switch (test) {
+      case eOPCODE_EQUAL:
+        result = (diff == 0);
+        break;
+      case eOPCODE_NOT_EQUAL:
+        result = (diff != 0);
+        break;
+      case eOPCODE_GREATER:
+        result = (diff > 0);
+        break;
+      case eOPCODE_LESS:
+        result = (diff < 0);
+        break;
+      case eOPCODE_GREATER_OR_EQUAL:
+        result = (diff >= 0);
+        break;
+      case eOPCODE_LESS_OR_EQUAL:
+        result = (diff <= 0);
+        break;
+    }
+    return result;
+  }
+
+  /**
+   * Hashes source text with 64-bit FNV-1a.
+   * @param text The source text.
+   * @param options The compile options, which change the compiled code.
+   * @return The hash.
+   */
+  unsigned long long Hash_Text(const std::string& text, int options) {
+    unsigned long long hash = 14695981039346656037ULL;
+    int length = (int)text.length();
+    for (int char_index = 0; char_index < length; char_index++) {
+      hash = (hash ^ (unsigned char)text[char_index]) * 1099511628211ULL;
+    }
+    return (hash ^ (unsigned int)options) * 1099511628211ULL;
+  }
+
+  /**
+   * Writes a number to a cache file.
+   * @param file The cache file.
+   * @param number The number.
+   */
+  void Write_Number(std::ostream& file, int number) {
+    file.write((const char*)&number, sizeof(int));
+  }
+
+  /**
+   * Reads a number from a cache file.
+   * @param file The cache file.
+   * @return The number or zero if the file ran out.
+   */
+  int Read_Number(std::istream& file) {
+    int number = 0;
+    file.read((char*)&number, sizeof(int));
+    return number;
+  }
+
+  /**
+   * Writes text to a cache file.
+   * @param file The cache file.
+   * @param text The text.
+   */
+  void Write_Text(std::ostream& file, const std::string& text) {
+    Write_Number(file, (int)text.length());
+    file.write(text.data(), text.length());
+  }
+
+  /**
+   * Reads text from a cache file.
+   * @param file The cache file.
+   * @return The text.
+   */
+  std::string Read_Text(std::istream& file) {
+    int length = Read_Number(file);
+    std::string text;
+    if (file && (length > 0)) {
+      text.resize(length);
+      file.read(&text[0], length);
+    }
+    return text;
+  }
+
+  /**
+   * Writes an array of numbers to a cache file.
+   * @param file The cache file.
+   * @param numbers The numbers.
+   */
+  void Write_Numbers(std::ostream& file, const std::vector<int>& numbers) {
+    Write_Number(file, (int)numbers.size());
+    file.write((const char*)numbers.data(), numbers.size() * sizeof(int));
+  }
+
+  /**
+   * Reads an array of numbers from a cache file.
+   * @param file The cache file.
+   * @param numbers Receives the numbers.
+   */
+  void Read_Numbers(std::istream& file, std::vector<int>& numbers) {
+    int count = Read_Number(file);
+    numbers.clear();
+    if (file && (count > 0)) {
+      numbers.resize(count);
+      file.read((char*)numbers.data(), count * sizeof(int));
+    }
+  }
+
+  /**
+   * Gets the area of the screen an image draw covers.
+   * @param values The x, y, width, height, angle and flips of the draw.
+   * @param left Receives the left edge.
+   * @param top Receives the top edge.
+   * @param right Receives the right edge.
+   * @param bottom Receives the bottom edge.
+   */
+  void Get_Draw_Bounds(const int* values, int& left, int& top, int& right, int& bottom) {
+    int x = values[0];
+    int y = values[1];
+    int width = values[2];
+    int height = values[3];
+    int reach = values[4] ? std::max(std::abs(width), std::abs(height)) : 0; // Room for any rotation.
+    left = std::min(x, x + width) - reach;
+    top = std::min(y, y + height) - reach;
+    right = std::max(x, x + width) + reach;
+    bottom = std::max(y, y + height) + reach;
+  }
+
+  /**
+   * Writes a container to a snapshot. An incremental snapshot writes a
+   * marker instead when the container is the same as in the last one.
+   * @param file The snapshot file.
+   * @param values The values of the container.
+   * @param count The number of values.
+   * @param base The container as of the last snapshot. Receives the values.
+   * @param incremental True to leave the container out if it did not change.
+   */
+  void Write_Changed(std::ostream& file, const int* values, int count, std::vector<int>& base, bool incremental) {
+    if (incremental && ((int)base.size() == count) && (std::memcmp(base.data(), values, count * sizeof(int)) == 0)) {
+      Write_Number(file, eSNAPSHOT_SAME);
+      return;
+    }
+    Write_Number(file, count);
+    file.write((const char*)values, count * sizeof(int));
+    if (incremental) {
+      base.assign(values, values + count);
+    }
+  }
+
+  /**
+   * Reads a container from a snapshot.
+   * @param file The snapshot file.
+   * @param values Receives the values.
+   * @return True if the container was read, false if it did not change.
+   */
+  bool Read_Changed(std::istream& file, std::vector<int>& values) {
+    int count = Read_Number(file);
+    if (count == eSNAPSHOT_SAME) {
+      return false;
+    }
+    values.clear();
+    if (file && (count > 0)) {
+      values.resize(count);
+      file.read((char*)values.data(), count * sizeof(int));
+    }
+    return true;
+  }
+
+  /**
+   * Gets the next number from a small repeatable generator. The generator
+   * is xorshift32, which gives all 32 bits, and numbers outside the last
+   * whole multiple of the range are drawn again so every number in the
+   * range is equally likely.
+   * @param seed The state of the generator. Zero is replaced since it never changes.
+   * @param low The lowest number.
+   * @param high The highest number.
+   * @return The random number.
+   */
+  int Next_Random(unsigned int& seed, int low, int high) {
+    long long range = (long long)high - low + 1;
+    if (range <= 0) {
+      return low;
+    }
+    unsigned long long limit = 0x100000000ULL - (0x100000000ULL % (unsigned long long)range);
+    unsigned long long value = 0;
+    if (seed == 0) {
+      seed = 0x9E3779B9;
+    }
+    do {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      value = seed;
+    }
+    while (value >= limit);
+    return (int)(low + (long long)(value % (unsigned long long)range));
+  }
+
+  /**
+   * Decodes a whole number without throwing on text that is not one.
+   * @param text The text to decode.
+   * @param number Receives the number.
+   * @return True if the text is a number which fits in an int, false otherwise.
+   */
+  bool Decode_Number(std::string text, int& number) {
+    int length = (int)text.length();
+    int start = ((length > 1) && ((text[0] == '-') || (text[0] == '+'))) ? 1 : 0;
+    long long limit = (text[0] == '-') ? -(long long)INT_MIN : (long long)INT_MAX;
+    long long value = 0;
+    if (start == length) {
+      return false;
+    }
+    for (int char_index = start; char_index < length; char_index++) {
+      if ((text[char_index] < '0') || (text[char_index] > '9')) {
+        return false;
+      }
+      value = (value * 10) + (text[char_index] - '0');
+      if (value > limit) {
+        return false; // Stops before long long could overflow too.
+      }
+    }
+    number = (int)((text[0] == '-') ? -value : value);
+    return true;
+  }
+
+  // **************************************************************************
+  // Source Implementation
+  // **************************************************************************
+
+  /**
+   * Creates a new source module.
+   * @param source The source code name.
+   * @param io The I/O control.
+   * @param options The compile options.
+   */
+  cSource::cSource(std::string source, cIO_Control* io, int options) {
+    this->pointer = 0;
+    this->cursor = 0;
+    this->options = options;
+    this->fold_symbols = false;
+    this->profiler = NULL;
+    this->file_suffix = "";
+    this->snapshot_base.valid = false;
+    this->random_seed = (unsigned int)io->Get_Random_Number(0, 0x7FFF);
+    this->signal_mode = eSIGNALS_LIVE;
+    this->signal_index = 0;
+    this->log_seed = 0;
+    this->log_frames = 0;
+    this->suspend = eSUSPEND_NONE;
+    this->batch_io = dynamic_cast<cBatch_Control*>(io);
+    this->resource_io = dynamic_cast<cResource_Control*>(io);
+    this->region_io = dynamic_cast<cRegion_Control*>(io);
+    this->draw_stats.frames = 0;
+    this->draw_stats.frame_draw_calls = 0;
+    this->draw_stats.frame_batches = 0;
+    this->draw_stats.draw_calls = 0;
+    this->draw_stats.batches = 0;
+    this->draw_stats.skipped_frames = 0;
+    this->draw_stats.partial_frames = 0;
+    this->run_stats.budget = eMIN_BUDGET;
+    this->run_stats.frames = 0;
+    this->run_stats.instructions = 0;
+    this->run_stats.frame_instructions = 0;
+    this->run_stats.overruns = 0;
+    this->run_stats.max_overrun = 0;
+    this->io = io;
+    this->status = eSTATUS_IDLE;
+    std::string text;
+    unsigned long long hash = 0;
+    bool hashed = Read_Text_File(source + ".ss", text);
+    if (hashed) {
+      hash = Hash_Text(text, this->options & eCOMPILE_OPTIONS);
+    }
+    this->from_cache = hashed && this->Load_Cache(source, hash);
+    if (!this->from_cache) {
+      this->Parse_Tokens(source);
+      this->Compile();
+      if (hashed) {
+        this->Save_Cache(source, hash);
+      }
+    }
+    this->Allocate_Storage();
+    if (this->options & eOPTION_PROFILE) {
+      this->profiler = new cProfiler(this, source);
+    }
+    this->status = eSTATUS_RUNNING;
+  }
+
+  /**
+   * Frees the source module.
+   */
+  cSource::~cSource() {
+    if (this->profiler) {
+      delete this->profiler;
+    }
+  }
+
+  /**
+   * Parses tokens from a source file.
+   * @param source The name of the source code.
+   * @throws An error if something went wrong.
+   */
+  void cSource::Parse_Tokens(std::string source) {
+    cFile source_file(source + ".ss");
+    source_file.Read();
+    int source_id = this->Add_Text(source);
+    int line_no = 0;
+    while (!source_file.Has_More_Lines()) {
+      std::string line = source_file.Get_Line();
+      line_no++;
+      if (line.length() > 0) {
+        if (line[0] == ':') { // Code line.
+          line = line.substr(1);
+          // Parse the tokens.
+          cArray<std::string> tokens = Parse_C_Lesh_Line(line);
+          int tok_count = tokens.Count();
           for (int tok_index = 0; tok_index < tok_count; tok_index++) {
-            sToken token;
+            sScript_Token token;
             token.line_no = line_no;
-            token.source = source;
-            token.token = tokens[tok_index];
+            token.source = source_id;
+            token.text = this->Add_Text(tokens[tok_index]);
+            this->Classify_Token(token);
             this->tokens.Add(token);
           }
         }
@@ -114,557 +1388,4412 @@ namespace Codeloader {
   }
 
   /**
-   * Generates a parse error.
-   * @param message The error message.
-   * @param token The associted token.
-   * @throws An error.
+   * Tags a token with its kind. Numbers are decoded here so nothing has
+   * to be converted or caught later on.
+   * @param token The token to classify.
+   * @throws An error if a number does not fit in an int.
+   */
+  void cSource::Classify_Token(sScript_Token& token) {
+    std::string& text = this->Get_Text(token);
+    token.kind = eTOKEN_NAME;
+    token.value = 0;
+    int start = ((text.length() > 1) && ((text[0] == '-') || (text[0] == '+'))) ? 1 : 0;
+    if (Decode_Number(text, token.value)) {
+      token.kind = eTOKEN_NUMBER;
+    }
+    else if (((int)text.length() > start) && (text.find_first_not_of("0123456789", start) == std::string::npos)) {
+      this->Generate_Parse_Error("Number is out of range.", token);
+    }
+    else if ((text.length() > 0) && (text[0] == '"')) {
+      token.kind = eTOKEN_STRING;
+    }
+    else if (text.find("->") != std::string::npos) {
+      token.kind = eTOKEN_ACCESSOR;
+    }
+    else {
+      for (int opcode = eOPCODE_ADD; opcode <= eOPCODE_OR; opcode++) {
+        if (text == opcode_infos[opcode].name) {
+          token.kind = eTOKEN_OPERATOR;
+          token.value = opcode;
+          return;
+        }
+      }
+      int keyword_count = sizeof(keywords) / sizeof(keywords[0]);
+      for (int keyword = 0; keyword < keyword_count; keyword++) {
+        if (text == keywords[keyword]) {
+          token.kind = eTOKEN_KEYWORD;
+          token.value = keyword;
+          return;
+        }
+      }
+    }
+  }
+
+  /**
+   * Generates a parse error.
+   * @param message The error message.
+   * @param token The associted token.
+   * @throws An error.
+   */
+  void cSource::Generate_Parse_Error(std::string message, sScript_Token& token) {
+    throw cError("Error: " + message + "\nLine No: " + Number_To_Text(token.line_no) + "\nSource: " + this->texts[token.source] + "\nToken: " + this->Get_Text(token));
+  }
+
+  /**
+   * Gets the text of a token.
+   * @param token The token.
+   * @return The text.
+   */
+  std::string& cSource::Get_Text(sScript_Token& token) {
+    return this->texts[token.text];
+  }
+
+  /**
+   * Runs the program for a time slice. The clock is only read every few
+   * instructions, how many depends on the budget measured in earlier slices.
+   * @param timeout The length of the slice in milliseconds.
+   * @throws An error if there is an illegal command.
+   */
+  void cSource::Run(int timeout) {
+    if (this->status == eSTATUS_DONE) {
+      return;
+    }
+    if (!this->Resume()) {
+      this->Update_Budget(0, 0, timeout); // Still counts as an idle frame.
+      return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto limit = std::chrono::milliseconds(timeout);
+    auto elapsed = std::chrono::steady_clock::duration::zero();
+    int check = std::max(this->run_stats.budget / eCLOCK_CHECKS, 1);
+    int count = 0;
+    bool profile = (this->profiler != NULL);
+    if (profile) {
+      this->profiler->Resume();
+    }
+    while ((this->status != eSTATUS_DONE) && (this->suspend == eSUSPEND_NONE)) {
+      for (int instr = 0; (instr < check) && (this->status != eSTATUS_DONE) && (this->suspend == eSUSPEND_NONE); instr++) {
+        if (profile) {
+          this->profiler->Step();
+        }
+        else {
+          this->Interpret();
+        }
+        count++;
+      }
+      elapsed = std::chrono::steady_clock::now() - start;
+      if (elapsed >= limit) {
+        break;
+      }
+    }
+    int micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    this->Update_Budget(count, micros, timeout);
+  }
+
+  /**
+   * Checks whether a suspended script may run again. Yielding scripts run
+   * again on the next call and scripts waiting for input poll once.
+   * @return True if the script may run.
+   */
+  bool cSource::Resume() {
+    if ((this->suspend == eSUSPEND_TIME) && (std::chrono::steady_clock::now() < this->wake_time)) {
+      return false;
+    }
+    this->suspend = eSUSPEND_NONE;
+    return true;
+  }
+
+  /**
+   * Gets how long the host may sleep before the script has work to do.
+   * @return The time in milliseconds, zero if the script should run at once
+   * or -1 if it waits for input.
+   */
+  int cSource::Get_Sleep_Time() {
+    int sleep = 0;
+    if (this->suspend == eSUSPEND_INPUT) {
+      sleep = -1;
+    }
+    else if (this->suspend == eSUSPEND_TIME) {
+      auto left = std::chrono::duration_cast<std::chrono::microseconds>(this->wake_time - std::chrono::steady_clock::now());
+      sleep = std::max((int)((left.count() + 999) / 1000), 0); // Rounded up so the host does not wake early and spin.
+    }
+    return sleep;
+  }
+
+  /**
+   * Runs a fixed number of statements so that the result does not depend
+   * on timing.
+   * @param steps The number of statements to run.
+   * @throws An error if there is an illegal command.
+   */
+  void cSource::Run_Steps(int steps) {
+    if ((this->status == eSTATUS_DONE) || !this->Resume()) {
+      return;
+    }
+    int count = 0;
+    if (this->profiler) {
+      this->profiler->Resume();
+    }
+    while ((count < steps) && (this->status != eSTATUS_DONE) && (this->suspend == eSUSPEND_NONE)) {
+      if (this->profiler) {
+        this->profiler->Step();
+      }
+      else {
+        this->Interpret();
+      }
+      count++;
+    }
+    this->run_stats.frames++;
+    this->run_stats.instructions += count;
+    this->run_stats.frame_instructions = count;
+  }
+
+  /**
+   * Records a time slice and adapts the budget to the measured speed.
+   * @param count The number of instructions run in the slice.
+   * @param micros The length of the slice in microseconds.
+   * @param timeout The requested length of the slice in milliseconds.
+   */
+  void cSource::Update_Budget(int count, int micros, int timeout) {
+    this->run_stats.frames++;
+    this->run_stats.instructions += count;
+    this->run_stats.frame_instructions = count;
+    int overrun = micros - (timeout * 1000);
+    if (overrun > (timeout * 1000) / eOVERRUN_TOLERANCE) {
+      this->run_stats.overruns++;
+    }
+    this->run_stats.max_overrun = std::max(this->run_stats.max_overrun, overrun);
+    if ((this->status != eSTATUS_DONE) && (this->suspend == eSUSPEND_NONE) && (micros > 0)) { // Partial slices say nothing about speed.
+      long long budget = ((long long)count * timeout * 1000) / micros;
+      budget = ((long long)this->run_stats.budget * 3 + budget) / 4; // Smooth out slow frames.
+      this->run_stats.budget = (int)std::min(std::max(budget, (long long)eMIN_BUDGET), (long long)eMAX_BUDGET);
+    }
+  }
+
+  /**
+   * Gets a token from the token stack but does not remove it.
+   * @return The token at the cursor.
+   * @throws An error if there are no more tokens.
+   */
+  sScript_Token& cSource::Get_Token() {
+    if (this->cursor >= this->tokens.Count()) {
+      throw cError("No more tokens left!");
+    }
+    return this->tokens[this->cursor++];
+  }
+
+  /**
+   * Gets the index of the token at the cursor and moves past it.
+   * @return The index of the token.
+   * @throws An error if there are no more tokens.
+   */
+  int cSource::Get_Token_Index() {
+    if (this->cursor >= this->tokens.Count()) {
+      throw cError("No more tokens left!");
+    }
+    return this->cursor++;
+  }
+
+  /**
+   * Pulls a token but does not increment the cursor.
+   * @return The token.
+   * @throws An error if there is no token.
+   */
+  sScript_Token& cSource::Peek_Token() {
+    if (this->cursor >= this->tokens.Count()) {
+      throw cError("No more tokens left!");
+    }
+    return this->tokens[this->cursor];
+  }
+
+  /**
+   * Determines if there are tokens left to compile.
+   * @return True if a token is at the cursor, false otherwise.
+   */
+  bool cSource::Has_Token() {
+    return (this->cursor < this->tokens.Count());
+  }
+
+  /**
+   * Checks to see if a keyword exists.
+   * @param keyword The keyword to check.
+   * @throws An error if the keyword does not exist.
+   */
+  void cSource::Check_Keyword(std::string keyword) {
+    sScript_Token& token = this->Get_Token();
+    if (this->Get_Text(token) != keyword) {
+      this->Generate_Parse_Error("Keyword " + keyword + " missing.", token);
+    }
+  }
+
+  // **************************************************************************
+  // Script Cache Implementation
+  // **************************************************************************
+
+  /**
+   * Loads the compiled program from its cache if the cache was made from
+   * the same source text.
+   * @param source The name of the source code.
+   * @param hash The hash of the source text.
+   * @return True if the cache was loaded, false if the source must be compiled.
+   */
+  bool cSource::Load_Cache(std::string source, unsigned long long hash) {
+    std::ifstream cache((source + ".ssc").c_str(), std::ios::binary);
+    if (!this->Read_Cache_Header(cache, hash)) {
+      return false;
+    }
+    int text_count = Read_Number(cache);
+    for (int text_index = 0; (text_index < text_count) && cache; text_index++) {
+      this->Add_Text(Read_Text(cache));
+    }
+    int source_id = this->Add_Text(source); // The program may have been renamed.
+    int token_count = Read_Number(cache);
+    for (int token_index = 0; (token_index < token_count) && cache; token_index++) {
+      sScript_Token token;
+      token.text = Read_Number(cache);
+      token.line_no = Read_Number(cache);
+      token.source = source_id;
+      token.kind = Read_Number(cache);
+      token.value = Read_Number(cache);
+      this->tokens.Add(token);
+    }
+    this->Read_Slots(cache, this->var_table);
+    this->Read_Slots(cache, this->list_table);
+    this->Read_Slots(cache, this->matrix_table);
+    this->Read_Slots(cache, this->string_table);
+    Read_Numbers(cache, this->code);
+    Read_Numbers(cache, this->code_tokens);
+    Read_Numbers(cache, this->statement_tokens);
+    if (!cache) { // Damaged, so start over.
+      this->tokens = cArray<sScript_Token>();
+      this->texts = cText_Pool();
+      this->var_table = cSlot_Table();
+      this->list_table = cSlot_Table();
+      this->matrix_table = cSlot_Table();
+      this->string_table = cSlot_Table();
+      this->code.clear();
+      this->code_tokens.clear();
+      this->statement_tokens.clear();
+      cache.close();
+      std::remove((source + ".ssc").c_str()); // So it gets written again.
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Reads the header of a cache and checks that it was made from the same
+   * source text by this version.
+   * @param cache The cache file.
+   * @param hash The hash of the source text.
+   * @return True if the header matches, false otherwise.
+   */
+  bool cSource::Read_Cache_Header(std::istream& cache, unsigned long long hash) {
+    char signature[4] = { 0, 0, 0, 0 };
+    cache.read(signature, 4);
+    if (!cache || (std::memcmp(signature, CACHE_SIGNATURE, 4) != 0)) {
+      return false;
+    }
+    unsigned long long cache_hash = 0;
+    cache.read((char*)&cache_hash, sizeof(cache_hash));
+    return (Read_Number(cache) == eCACHE_VERSION) && (Read_Number(cache) == eOPCODE_COUNT) && (cache_hash == hash) && cache;
+  }
+
+  /**
+   * Saves the compiled program next to its source. The cache is written
+   * to a temporary file and moved into place, and it is not written again
+   * while a cache of the same source is there. A cache that cannot be
+   * written is skipped since the program can always be compiled again.
+   * @param source The name of the source code.
+   * @param hash The hash of the source text.
+   */
+  void cSource::Save_Cache(std::string source, unsigned long long hash) {
+    std::ifstream current((source + ".ssc").c_str(), std::ios::binary);
+    if (this->Read_Cache_Header(current, hash)) {
+      return; // Already written for this source.
+    }
+    current.close();
+    std::string temp_name = source + ".ssc.tmp";
+    std::ofstream cache(temp_name.c_str(), std::ios::binary | std::ios::trunc);
+    cache.write(CACHE_SIGNATURE, 4);
+    cache.write((const char*)&hash, sizeof(hash));
+    Write_Number(cache, eCACHE_VERSION);
+    Write_Number(cache, eOPCODE_COUNT);
+    int text_count = this->texts.Count();
+    Write_Number(cache, text_count);
+    for (int text_index = 0; text_index < text_count; text_index++) {
+      Write_Text(cache, this->texts[text_index]);
+    }
+    int token_count = this->tokens.Count();
+    Write_Number(cache, token_count);
+    for (int token_index = 0; token_index < token_count; token_index++) {
+      sScript_Token& token = this->tokens[token_index];
+      Write_Number(cache, token.text);
+      Write_Number(cache, token.line_no);
+      Write_Number(cache, token.kind);
+      Write_Number(cache, token.value);
+    }
+    this->Write_Slots(cache, this->var_table);
+    this->Write_Slots(cache, this->list_table);
+    this->Write_Slots(cache, this->matrix_table);
+    this->Write_Slots(cache, this->string_table);
+    Write_Numbers(cache, this->code);
+    Write_Numbers(cache, this->code_tokens);
+    Write_Numbers(cache, this->statement_tokens);
+    cache.close();
+    if (!cache || !Replace_File(temp_name, source + ".ssc")) {
+      std::remove(temp_name.c_str());
+    }
+  }
+
+  /**
+   * Reads the names of a slot table from the cache.
+   * @param cache The cache file.
+   * @param table The slot table.
+   */
+  void cSource::Read_Slots(std::istream& cache, cSlot_Table& table) {
+    int slot_count = Read_Number(cache);
+    for (int slot_index = 0; (slot_index < slot_count) && cache; slot_index++) {
+      std::string name = Read_Text(cache);
+      int slot = table.Resolve(name, Read_Number(cache));
+      if (Read_Number(cache)) {
+        table.Declare(slot);
+      }
+    }
+  }
+
+  /**
+   * Writes the names of a slot table to the cache.
+   * @param cache The cache file.
+   * @param table The slot table.
+   */
+  void cSource::Write_Slots(std::ostream& cache, cSlot_Table& table) {
+    int slot_count = table.Count();
+    Write_Number(cache, slot_count);
+    for (int slot_index = 0; slot_index < slot_count; slot_index++) {
+      Write_Text(cache, table.names[slot_index]);
+      Write_Number(cache, table.tokens[slot_index]);
+      Write_Number(cache, table.declared[slot_index]);
+    }
+  }
+
+  // **************************************************************************
+  // Snapshot Implementation
+  // **************************************************************************
+
+  /**
+   * Writes the state of the running program: where it is, its return stack
+   * and every variable and container. The first incremental snapshot holds
+   * everything. The ones after it leave out containers which did not change,
+   * so they must be restored in order on top of it.
+   * @param file The snapshot file.
+   * @param incremental True to leave out containers which did not change.
+   */
+  void cSource::Save_Snapshot(std::ostream& file, bool incremental) {
+    bool changes_only = incremental && this->snapshot_base.valid;
+    unsigned long long hash = this->Hash_Code();
+    file.write(SNAPSHOT_SIGNATURE, 4);
+    file.write((const char*)&hash, sizeof(hash));
+    Write_Number(file, eSNAPSHOT_VERSION);
+    Write_Number(file, this->pointer);
+    Write_Number(file, this->status);
+    Write_Number(file, this->suspend);
+    Write_Number(file, this->Get_Sleep_Time());
+    Write_Number(file, (int)this->random_seed);
+    int depth = this->stack.Count();
+    Write_Number(file, depth);
+    for (int stack_index = 0; stack_index < depth; stack_index++) {
+      Write_Number(file, this->stack[stack_index]);
+    }
+    Write_Numbers(file, this->vars);
+    sSnapshot_Base& base = this->snapshot_base;
+    int list_count = this->lists.size();
+    base.lists.resize(list_count);
+    Write_Number(file, list_count);
+    for (int list_index = 0; list_index < list_count; list_index++) {
+      std::vector<int>& list = this->lists[list_index];
+      Write_Changed(file, list.data(), list.size(), base.lists[list_index], changes_only);
+    }
+    int matrix_count = this->matrices.size();
+    base.cells.resize(matrix_count);
+    Write_Number(file, matrix_count);
+    for (int matrix_index = 0; matrix_index < matrix_count; matrix_index++) {
+      cFlat_Matrix& matrix = this->matrices[matrix_index];
+      Write_Number(file, matrix.width);
+      Write_Number(file, matrix.height);
+      Write_Changed(file, matrix.cells, matrix.Count(), base.cells[matrix_index], changes_only);
+    }
+    int string_count = this->strings.size();
+    base.strings.resize(string_count);
+    Write_Number(file, string_count);
+    for (int string_index = 0; string_index < string_count; string_index++) {
+      std::string& text = this->strings[string_index];
+      if (changes_only && (base.strings[string_index] == text)) {
+        Write_Number(file, eSNAPSHOT_SAME);
+      }
+      else {
+        Write_Number(file, 0);
+        Write_Text(file, text);
+        if (changes_only) {
+          base.strings[string_index] = text;
+        }
+      }
+    }
+    if (incremental && !changes_only) { // The first of a new chain.
+      for (int list_index = 0; list_index < list_count; list_index++) {
+        base.lists[list_index] = this->lists[list_index];
+      }
+      for (int matrix_index = 0; matrix_index < matrix_count; matrix_index++) {
+        cFlat_Matrix& matrix = this->matrices[matrix_index];
+        base.cells[matrix_index].assign(matrix.cells, matrix.cells + matrix.Count());
+      }
+      base.strings = this->strings;
+      base.valid = true;
+    }
+  }
+
+  /**
+   * Restores the state of the program from a snapshot. Nothing is changed
+   * unless the whole snapshot could be read. Incremental snapshots taken
+   * afterwards start a new chain.
+   * @param file The snapshot file.
+   * @return True if the snapshot was restored, false if it is missing,
+   * damaged or was taken from different code.
+   */
+  bool cSource::Load_Snapshot(std::istream& file) {
+    char signature[4] = { 0, 0, 0, 0 };
+    unsigned long long hash = 0;
+    file.read(signature, 4);
+    file.read((char*)&hash, sizeof(hash));
+    if (!file || (std::memcmp(signature, SNAPSHOT_SIGNATURE, 4) != 0) ||
+        (hash != this->Hash_Code()) || (Read_Number(file) != eSNAPSHOT_VERSION)) {
+      return false;
+    }
+    int pointer = Read_Number(file);
+    int status = Read_Number(file);
+    int suspend = Read_Number(file);
+    int sleep = Read_Number(file);
+    unsigned int random_seed = (unsigned int)Read_Number(file);
+    std::vector<int> stack(std::max(Read_Number(file), 0));
+    int depth = stack.size();
+    for (int stack_index = 0; (stack_index < depth) && file; stack_index++) {
+      stack[stack_index] = Read_Number(file);
+    }
+    std::vector<int> vars;
+    Read_Numbers(file, vars);
+    if (!file || (vars.size() != this->vars.size()) || (Read_Number(file) != (int)this->lists.size())) {
+      return false;
+    }
+    std::vector<std::vector<int> > lists = this->lists;
+    int list_count = lists.size();
+    std::vector<int> values;
+    for (int list_index = 0; (list_index < list_count) && file; list_index++) {
+      if (Read_Changed(file, values)) {
+        lists[list_index].swap(values);
+      }
+    }
+    if (!file || (Read_Number(file) != (int)this->matrices.size())) {
+      return false;
+    }
+    int matrix_count = this->matrices.size();
+    std::vector<cFlat_Matrix> matrices(matrix_count);
+    std::vector<bool> matrix_changes(matrix_count, false);
+    for (int matrix_index = 0; (matrix_index < matrix_count) && file; matrix_index++) {
+      int width = Read_Number(file);
+      int height = Read_Number(file);
+      if (Read_Changed(file, values)) {
+        if ((width < 0) || (height < 0) || ((int)values.size() != (width * height))) {
+          return false;
+        }
+        matrices[matrix_index] = cFlat_Matrix(width, height);
+        std::copy(values.begin(), values.end(), matrices[matrix_index].cells);
+        matrix_changes[matrix_index] = true;
+      }
+    }
+    if (!file || (Read_Number(file) != (int)this->strings.size())) {
+      return false;
+    }
+    std::vector<std::string> strings = this->strings;
+    int string_count = strings.size();
+    for (int string_index = 0; (string_index < string_count) && file; string_index++) {
+      if (Read_Number(file) != eSNAPSHOT_SAME) {
+        strings[string_index] = Read_Text(file);
+      }
+    }
+    if (!file) {
+      return false;
+    }
+    this->pointer = pointer;
+    this->status = status;
+    this->suspend = suspend;
+    this->random_seed = random_seed;
+    this->wake_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(sleep, 0));
+    this->stack = cArray<int>();
+    for (int stack_index = 0; stack_index < depth; stack_index++) {
+      this->stack.Push(stack[stack_index]);
+    }
+    this->vars.swap(vars);
+    this->lists.swap(lists);
+    for (int matrix_index = 0; matrix_index < matrix_count; matrix_index++) {
+      if (matrix_changes[matrix_index]) {
+        this->matrices[matrix_index] = matrices[matrix_index];
+      }
+    }
+    this->strings.swap(strings);
+    this->snapshot_base.valid = false;
+    this->shown_list.clear(); // The screen no longer matches, so draw all of the next frame.
+    return true;
+  }
+
+  /**
+   * Hashes the compiled code so a snapshot is only restored into the
+   * program it was taken from.
+   * @return The hash.
+   */
+  unsigned long long cSource::Hash_Code() {
+    unsigned long long hash = 14695981039346656037ULL;
+    int code_count = this->code.size();
+    for (int code_index = 0; code_index < code_count; code_index++) {
+      hash = (hash ^ (unsigned int)this->code[code_index]) * 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  // **************************************************************************
+  // Record and Replay Implementation
+  // **************************************************************************
+
+  /**
+   * Reads a signal for the script. Recorded signals are logged with the
+   * frame they were read in and replayed signals are given back in the
+   * same frame.
+   * @return The code of the signal or zero if there is none.
+   */
+  int cSource::Read_Signal() {
+    int code = 0;
+    int frame = this->draw_stats.frames;
+    if (this->signal_mode == eSIGNALS_REPLAY) {
+      int signal_count = this->signal_log.size();
+      while ((this->signal_index < signal_count) && (this->signal_log[this->signal_index].frame < frame)) {
+        this->signal_index++; // Missed, so the run went another way.
+      }
+      if ((this->signal_index < signal_count) && (this->signal_log[this->signal_index].frame == frame)) {
+        code = this->signal_log[this->signal_index++].code;
+      }
+    }
+    else {
+      code = this->io->Read_Signal().code;
+      if (code && (this->signal_mode == eSIGNALS_RECORD)) {
+        sSignal_Entry entry;
+        entry.frame = frame;
+        entry.code = code;
+        this->signal_log.push_back(entry);
+      }
+    }
+    return code;
+  }
+
+  /**
+   * Starts recording the signals the script reads. Must be called before
+   * the script runs so the random seed is the one it starts with.
+   */
+  void cSource::Record_Signals() {
+    this->signal_mode = eSIGNALS_RECORD;
+    this->signal_log.clear();
+    this->log_seed = this->random_seed;
+  }
+
+  /**
+   * Writes the recorded signals. The first lines hold the random seed and
+   * the number of frames, then each signal is a frame and a code.
+   * @param name The name of the recording.
+   */
+  void cSource::Save_Signals(std::string name) {
+    std::ofstream file(name.c_str());
+    file << "seed " << this->log_seed << std::endl;
+    file << "frames " << this->draw_stats.frames << std::endl;
+    int signal_count = this->signal_log.size();
+    for (int signal_index = 0; signal_index < signal_count; signal_index++) {
+      file << this->signal_log[signal_index].frame << " " << this->signal_log[signal_index].code << std::endl;
+    }
+  }
+
+  /**
+   * Loads a recording and replays its signals instead of reading live ones.
+   * The script gets the random seed of the recorded run.
+   * @param name The name of the recording.
+   * @return True if the recording was loaded, false otherwise.
+   */
+  bool cSource::Replay_Signals(std::string name) {
+    std::ifstream file(name.c_str());
+    std::string seed_label;
+    std::string frames_label;
+    file >> seed_label >> this->log_seed >> frames_label >> this->log_frames;
+    if (!file || (seed_label != "seed") || (frames_label != "frames")) {
+      return false;
+    }
+    this->signal_log.clear();
+    sSignal_Entry entry;
+    while (file >> entry.frame >> entry.code) {
+      this->signal_log.push_back(entry);
+    }
+    this->signal_mode = eSIGNALS_REPLAY;
+    this->signal_index = 0;
+    this->random_seed = this->log_seed;
+    return true;
+  }
+
+  /**
+   * Gets the frame of the next replayed signal.
+   * @return The frame or -1 if no signals are left.
+   */
+  int cSource::Next_Signal_Frame() {
+    if (this->signal_index < (int)this->signal_log.size()) {
+      return this->signal_log[this->signal_index].frame;
+    }
+    return -1;
+  }
+
+  // **************************************************************************
+  // Compiler Implementation
+  // **************************************************************************
+
+  /**
+   * Compiles the token stream into code. Commands and operators are
+   * matched here once so the interpreter only has to dispatch on opcodes.
+   * The first pass finds the symbols which are never written so that the
+   * second pass can fold them into the expressions that use them.
+   * @throws An error if a command is malformed.
+   */
+  void cSource::Compile() {
+    this->Compile_Pass();
+    this->fold_symbols = true;
+    this->Compile_Pass();
+    this->Resolve_Calls();
+    this->Check_Slots(this->var_table, "Symbol ");
+    this->Check_Slots(this->list_table, "List ");
+    this->Check_Slots(this->matrix_table, "Matrix ");
+    this->Check_Slots(this->string_table, "String ");
+  }
+
+  /**
+   * Makes room for every variable, list, matrix and string.
+   */
+  void cSource::Allocate_Storage() {
+    this->vars.assign(this->var_table.Count(), 0);
+    this->var_presets.assign(this->var_table.Count(), 0);
+    this->lists.resize(this->list_table.Count());
+    this->matrices.resize(this->matrix_table.Count());
+    this->strings.resize(this->string_table.Count());
+  }
+
+  /**
+   * Compiles the whole token stream once.
+   * @throws An error if a command is malformed.
+   */
+  void cSource::Compile_Pass() {
+    this->cursor = 0;
+    this->code.clear();
+    this->code_tokens.clear();
+    this->statement_tokens.clear();
+    this->subroutines = cHash<std::string, int>();
+    this->calls = cArray<sFixup>();
+    while (this->Has_Token()) {
+      this->Compile_Statement();
+    }
+    if (this->blocks.Count() > 0) {
+      sBlock block = this->blocks.Pop();
+      this->Generate_Parse_Error("Block is missing its end.", this->tokens[block.token]);
+    }
+    this->Emit(eOPCODE_EXIT);
+    this->statement_tokens.resize(this->code.size(), -1);
+  }
+
+  /**
+   * Points every call at the body of its subroutine.
+   * @throws An error if a subroutine does not exist.
+   */
+  void cSource::Resolve_Calls() {
+    int call_count = this->calls.Count();
+    for (int call_index = 0; call_index < call_count; call_index++) {
+      sFixup& call = this->calls[call_index];
+      sScript_Token& name = this->tokens[call.token];
+      if (!this->subroutines.Does_Key_Exist(this->Get_Text(name))) {
+        this->Generate_Parse_Error("Subroutine " + this->Get_Text(name) + " was not found.", name);
+      }
+      this->code[call.position] = this->subroutines[this->Get_Text(name)];
+    }
+  }
+
+  /**
+   * Makes sure every name used in a table is declared somewhere.
+   * @param table The slot table.
+   * @param message The start of the error message.
+   * @throws An error if a name is never declared.
+   */
+  void cSource::Check_Slots(cSlot_Table& table, std::string message) {
+    int slot_count = table.Count();
+    for (int slot = 0; slot < slot_count; slot++) {
+      if (!table.declared[slot]) {
+        this->Generate_Parse_Error(message + table.names[slot] + " was not found.", this->tokens[table.tokens[slot]]);
+      }
+    }
+  }
+
+  /**
+   * Compiles a single command. Expressions are emitted in postfix order
+   * ahead of the command opcode which consumes their values. Blocks are
+   * matched here so every jump target is known before the program runs.
+   * @throws An error if the command is invalid.
+   */
+  void cSource::Compile_Statement() {
+    int command_pos = (int)this->code.size();
+    int command_index = this->Get_Token_Index();
+    sScript_Token& command = this->tokens[command_index];
+    std::string& command_text = this->Get_Text(command);
+    if (command_text == "if") {
+      this->Compile_Conditional(eOPCODE_IF, eOPCODE_IF_CONST, -1);
+      this->Check_Keyword("then");
+      this->Emit_Word(0, this->cursor - 1);
+      this->Open_Block(eOPCODE_IF, command_index);
+    }
+    else if (command_text == "else") {
+      if ((this->blocks.Count() == 0) || (this->blocks[this->blocks.Count() - 1].opcode != eOPCODE_IF)) {
+        this->Generate_Parse_Error("Else does not match an if.", command);
+      }
+      this->Emit(eOPCODE_ELSE, 0);
+      sBlock& block = this->blocks[this->blocks.Count() - 1];
+      this->code[block.fixup] = (int)this->code.size(); // False if lands in else.
+      block.opcode = eOPCODE_ELSE;
+      block.fixup = (int)this->code.size() - 1;
+    }
+    else if (command_text == "end") {
+      if (this->blocks.Count() == 0) {
+        this->Generate_Parse_Error("End does not match a block.", command);
+      }
+      sBlock block = this->blocks.Pop();
+      if ((block.opcode == eOPCODE_WHILE) || (block.opcode == eOPCODE_SUBROUTINE)) {
+        this->Emit(eOPCODE_END); // An if has nothing to return to.
+      }
+      this->code[block.fixup] = (int)this->code.size();
+    }
+    else if (command_text == "while") {
+      this->Compile_Conditional(eOPCODE_WHILE, eOPCODE_WHILE_CONST, eOPCODE_WHILE_VARS);
+      this->Check_Keyword("do");
+      this->Emit_Word(command_pos, this->cursor - 1); // Start position of while.
+      this->Emit_Word(0, this->cursor - 1);
+      this->Open_Block(eOPCODE_WHILE, command_index);
+    }
+    else if (command_text == "subroutine") {
+      int name = this->Get_Token_Index();
+      if (this->subroutines.Does_Key_Exist(this->Get_Text(this->tokens[name]))) {
+        this->Generate_Parse_Error("Subroutine " + this->Get_Text(this->tokens[name]) + " is already defined.", this->tokens[name]);
+      }
+      this->Emit(eOPCODE_SUBROUTINE, name, 0);
+      this->Open_Block(eOPCODE_SUBROUTINE, command_index);
+      this->subroutines[this->Get_Text(this->tokens[name])] = (int)this->code.size();
+    }
+    else if (command_text == "call") {
+      sFixup call;
+      call.token = this->Get_Token_Index();
+      this->Emit(eOPCODE_CALL, 0); // Resolved once all subroutines are known.
+      call.position = (int)this->code.size() - 1;
+      this->calls.Add(call);
+    }
+    else if (command_text == "store") {
+      this->nodes.clear();
+      int value = this->Parse_Expression(1);
+      this->Check_Keyword("in");
+      if (!this->Fuse_Step(value)) {
+        this->Generate_Node(value);
+        this->Compile_Location();
+      }
+    }
+    else if ((command_text == "output") || (command_text == "number")) {
+      int name = this->Compile_Name((command_text == "output") ? this->string_table : this->var_table, false);
+      this->Check_Keyword("at");
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Check_Keyword("color");
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Emit((command_text == "output") ? eOPCODE_OUTPUT : eOPCODE_NUMBER, name);
+    }
+    else if (command_text == "define") {
+      int name = this->Compile_Name(this->var_table, true);
+      this->Check_Keyword("as");
+      sScript_Token& value = this->Get_Token();
+      if (value.kind != eTOKEN_NUMBER) {
+        this->Generate_Parse_Error("Invalid value " + this->Get_Text(value) + ".", value);
+      }
+      this->Note_Symbol(name, true, value.value);
+      this->Emit(eOPCODE_DEFINE, name, value.value);
+    }
+    else if (command_text == "object") {
+      sScript_Token& name = this->Get_Token();
+      this->Check_Keyword("as");
+      int index = 0;
+      int field = this->Get_Token_Index();
+      while (this->Get_Text(this->tokens[field]) != "end") {
+        int slot = this->var_table.Resolve(this->Get_Text(name) + ":" + this->Get_Text(this->tokens[field]), field);
+        this->var_table.Declare(slot);
+        this->Note_Symbol(slot, true, index);
+        this->Emit(eOPCODE_DEFINE, slot, index++);
+        field = this->Get_Token_Index();
+      }
+    }
+    else if (command_text == "map") {
+      int index = 0;
+      int value = this->Get_Token_Index();
+      while (this->Get_Text(this->tokens[value]) != "end") {
+        int slot = this->var_table.Resolve(this->Get_Text(this->tokens[value]), value);
+        this->var_table.Declare(slot);
+        this->Note_Symbol(slot, true, index);
+        this->Emit(eOPCODE_DEFINE, slot, index++);
+        value = this->Get_Token_Index();
+      }
+    }
+    else if (command_text == "var") {
+      int name = this->Compile_Name(this->var_table, true);
+      this->Note_Symbol(name, false, 0);
+      this->Emit(eOPCODE_VAR, name);
+    }
+    else if (command_text == "list") {
+      int name = this->Compile_Name(this->list_table, true);
+      this->Check_Keyword("size");
+      this->Compile_Expression();
+      this->Emit(eOPCODE_LIST, name);
+    }
+    else if (command_text == "matrix") {
+      int name = this->Compile_Name(this->matrix_table, true);
+      this->Check_Keyword("size");
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Emit(eOPCODE_MATRIX, name);
+    }
+    else if (command_text == "string") {
+      int name = this->Compile_Name(this->string_table, true);
+      this->Check_Keyword("as");
+      sScript_Token& string = this->Get_Token();
+      this->Emit(eOPCODE_STRING, name, this->Add_Text(C_Lesh_String_To_Cpp_String(this->Get_Text(string))));
+    }
+    else if (command_text == "load") {
+      int name = this->Compile_Name(this->matrix_table, false);
+      this->Check_Keyword("from");
+      sScript_Token& file = this->Get_Token();
+      int file_id = this->Add_Text(C_Lesh_String_To_Cpp_String(this->Get_Text(file)));
+      if (this->Has_Token() && (this->Get_Text(this->Peek_Token()) == "at")) { // Window of a bigger map.
+        this->Get_Token();
+        this->Compile_Expression();
+        this->Compile_Expression();
+        this->Emit(eOPCODE_LOAD_WINDOW, name, file_id);
+      }
+      else {
+        this->Emit(eOPCODE_LOAD, name, file_id);
+      }
+    }
+    else if (command_text == "save") {
+      sScript_Token& file = this->Get_Token();
+      int file_id = this->Add_Text(C_Lesh_String_To_Cpp_String(this->Get_Text(file)));
+      this->Check_Keyword("to");
+      int name = this->Compile_Name(this->matrix_table, false);
+      this->Emit(eOPCODE_SAVE, name, file_id);
+    }
+    else if ((command_text == "snapshot") || (command_text == "restore")) {
+      this->Check_Keyword((command_text == "snapshot") ? "to" : "from");
+      sScript_Token& file = this->Get_Token();
+      int file_id = this->Add_Text(C_Lesh_String_To_Cpp_String(this->Get_Text(file)));
+      this->Emit((command_text == "snapshot") ? eOPCODE_SNAPSHOT : eOPCODE_RESTORE, file_id);
+    }
+    else if (command_text == "draw") {
+      sScript_Token& name = this->Get_Token();
+      int image = name.text; // Names are already in the text pool.
+      this->Check_Keyword("at");
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Check_Keyword("angle");
+      this->Compile_Expression();
+      this->Check_Keyword("flip");
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Emit(eOPCODE_DRAW, image);
+    }
+    else if (command_text == "sound") {
+      sScript_Token& name = this->Get_Token();
+      this->Emit(eOPCODE_SOUND, name.text);
+    }
+    else if (command_text == "music") {
+      sScript_Token& name = this->Get_Token();
+      this->Emit(eOPCODE_MUSIC, name.text);
+    }
+    else if (command_text == "silence") {
+      this->Emit(eOPCODE_SILENCE);
+    }
+    else if (command_text == "refresh") {
+      this->Emit(eOPCODE_REFRESH);
+    }
+    else if (command_text == "color") {
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Emit(eOPCODE_COLOR);
+    }
+    else if (command_text == "fill") {
+      int slot = 0;
+      int kind = this->Compile_Container(slot);
+      this->Check_Keyword("with");
+      this->Compile_Expression();
+      this->Emit(eOPCODE_FILL, kind, slot);
+    }
+    else if (command_text == "copy") {
+      int source = 0;
+      int kind = this->Compile_Container(source);
+      this->Check_Keyword("to");
+      int dest = this->Compile_Name((kind == eCONTAINER_LIST) ? this->list_table : this->matrix_table, false);
+      this->Emit(eOPCODE_COPY, kind, source, dest);
+    }
+    else if (command_text == "blit") {
+      int source = this->Compile_Name(this->matrix_table, false);
+      this->Check_Keyword("at");
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Check_Keyword("size");
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Check_Keyword("to");
+      int dest = this->Compile_Name(this->matrix_table, false);
+      this->Check_Keyword("at");
+      this->Compile_Expression();
+      this->Compile_Expression();
+      this->Emit(eOPCODE_BLIT, source, dest);
+    }
+    else if (command_text == "add") {
+      this->Compile_Expression();
+      this->Check_Keyword("to");
+      int slot = 0;
+      int kind = this->Compile_Container(slot);
+      this->Emit(eOPCODE_ADD_TO, kind, slot);
+    }
+    else if (command_text == "multiply") {
+      int slot = 0;
+      int kind = this->Compile_Container(slot);
+      this->Check_Keyword("by");
+      this->Compile_Expression();
+      this->Emit(eOPCODE_MULTIPLY_BY, kind, slot);
+    }
+    else if ((command_text == "sum") || (command_text == "minimum") || (command_text == "maximum")) {
+      int opcode = (command_text == "sum") ? eOPCODE_SUM : (command_text == "minimum") ? eOPCODE_MINIMUM : eOPCODE_MAXIMUM;
+      int slot = 0;
+      int kind = this->Compile_Container(slot);
+      this->Check_Keyword("in");
+      this->Emit(opcode, kind, slot);
+      this->Compile_Location();
+    }
+    else if (command_text == "collide") {
+      int slot = 0;
+      int kind = this->Compile_Container(slot);
+      this->Check_Keyword("to");
+      int result = this->Compile_Name(this->list_table, false);
+      this->Check_Keyword("in");
+      this->Emit(eOPCODE_COLLIDE, kind, slot, result);
+      this->Compile_Location();
+    }
+    else if (command_text == "nearest") {
+      int slot = 0;
+      int kind = this->Compile_Container(slot);
+      this->Check_Keyword("within");
+      this->Compile_Expression();
+      this->Check_Keyword("to");
+      int result = this->Compile_Name(this->list_table, false);
+      this->Check_Keyword("in");
+      this->Emit(eOPCODE_NEAREST, kind, slot, result);
+      this->Compile_Location();
+    }
+    else if (command_text == "getkey") {
+      this->Emit(eOPCODE_GETKEY);
+      this->Compile_Location();
+    }
+    else if (command_text == "waitkey") {
+      this->Emit(eOPCODE_WAITKEY); // Must start the statement so it can be run again.
+      this->Compile_Location();
+    }
+    else if (command_text == "progress") {
+      this->Emit(eOPCODE_PROGRESS);
+      this->Compile_Location();
+    }
+    else if (command_text == "yield") {
+      this->Emit(eOPCODE_YIELD);
+    }
+    else if (command_text == "wait") {
+      this->Compile_Expression();
+      this->Emit(eOPCODE_WAIT);
+    }
+    else if (command_text == "stop") {
+      this->Emit(eOPCODE_STOP);
+    }
+    else {
+      this->Generate_Parse_Error("Invalid command " + command_text + ".", command);
+    }
+    this->statement_tokens.resize(this->code.size(), -1);
+    if ((int)this->code.size() > command_pos) { // An end of an if emits nothing.
+      this->statement_tokens[command_pos] = command_index;
+    }
+  }
+
+  /**
+   * Compiles the name at the cursor into a slot of a table.
+   * @param table The slot table of the name.
+   * @param declare True if the name is being declared.
+   * @return The slot of the name.
+   * @throws An error if there is no name.
+   */
+  int cSource::Compile_Name(cSlot_Table& table, bool declare) {
+    int index = this->Get_Token_Index();
+    int slot = table.Resolve(this->Get_Text(this->tokens[index]), index);
+    if (declare) {
+      table.Declare(slot);
+    }
+    return slot;
+  }
+
+  /**
+   * Compiles a container written as list <name> or matrix <name>.
+   * @param slot Receives the slot of the container.
+   * @return The kind of container.
+   * @throws An error if the container is not a list or matrix.
+   */
+  int cSource::Compile_Container(int& slot) {
+    sScript_Token& kind = this->Get_Token();
+    int container = eCONTAINER_LIST;
+    if (this->Get_Text(kind) == "list") {
+      slot = this->Compile_Name(this->list_table, false);
+    }
+    else if (this->Get_Text(kind) == "matrix") {
+      container = eCONTAINER_MATRIX;
+      slot = this->Compile_Name(this->matrix_table, false);
+    }
+    else {
+      this->Generate_Parse_Error("Expected list or matrix.", kind);
+    }
+    return container;
+  }
+
+  /**
+   * Parses an operand into a leaf node pushing a constant, variable or
+   * accessor. Symbols that are only ever defined become constants.
+   * @return The index of the node.
+   * @throws An error if there is no operand.
+   */
+  int cSource::Parse_Operand() {
+    int index = this->Get_Token_Index();
+    sScript_Token& token = this->tokens[index];
+    int node = -1;
+    if (token.kind == eTOKEN_NUMBER) {
+      node = this->Make_Leaf(eOPCODE_PUSH_CONST, index, token.value, 0, 0);
+    }
+    else if (token.kind == eTOKEN_ACCESSOR) {
+      node = this->Make_Accessor(index, eOPCODE_PUSH_LIST, eOPCODE_PUSH_MATRIX);
+    }
+    else { // Probably a placeholder.
+      int slot = this->var_table.Resolve(this->Get_Text(token), index);
+      if (this->Is_Constant(slot)) {
+        node = this->Make_Leaf(eOPCODE_PUSH_CONST, index, this->symbols[slot].value, 0, 0);
+      }
+      else {
+        node = this->Make_Leaf(eOPCODE_PUSH_VAR, index, slot, 0, 0);
+      }
+    }
+    return node;
+  }
+
+  /**
+   * Compiles the location a value is stored at.
+   * @throws An error if there is no location.
+   */
+  void cSource::Compile_Location() {
+    int index = this->Get_Token_Index();
+    sScript_Token& location = this->tokens[index];
+    this->nodes.clear();
+    if (location.kind == eTOKEN_ACCESSOR) {
+      this->Generate_Node(this->Make_Accessor(index, eOPCODE_STORE_LIST, eOPCODE_STORE_MATRIX));
+    }
+    else {
+      int slot = this->var_table.Resolve(this->Get_Text(location), index);
+      this->Note_Symbol(slot, false, 0);
+      this->Emit(eOPCODE_STORE_VAR, slot);
+    }
+  }
+
+  /**
+   * Makes a leaf node for a list or matrix accessor. The container and its
+   * index variables are resolved to slots so no text is split at run time.
+   * @param index The index of the accessor token.
+   * @param list_opcode The opcode used for a list.
+   * @param matrix_opcode The opcode used for a matrix.
+   * @return The index of the node.
+   * @throws An error if the accessor has the wrong number of parts.
+   */
+  int cSource::Make_Accessor(int index, int list_opcode, int matrix_opcode) {
+    sScript_Token& token = this->tokens[index];
+    cArray<std::string> parts = Parse_Sausage_Text(this->Get_Text(token), "->");
+    int node = -1;
+    if (parts.Count() == 2) { // List
+      int list = this->list_table.Resolve(parts[0], index);
+      int var = this->var_table.Resolve(parts[1], index);
+      node = this->Make_Leaf(list_opcode, index, list, var, 0);
+    }
+    else if (parts.Count() == 3) { // Matrix
+      int matrix = this->matrix_table.Resolve(parts[0], index);
+      int var_y = this->var_table.Resolve(parts[1], index);
+      int var_x = this->var_table.Resolve(parts[2], index);
+      node = this->Make_Leaf(matrix_opcode, index, matrix, var_y, var_x);
+    }
+    else {
+      this->Generate_Parse_Error("Invalid dimension type.", token);
+    }
+    return node;
+  }
+
+  /**
+   * Compiles an expression into a tree which is folded and then emitted.
+   * @throws An error if something went wrong.
+   */
+  void cSource::Compile_Expression() {
+    this->nodes.clear();
+    this->Generate_Node(this->Parse_Expression(1));
+  }
+
+  /**
+   * Parses an expression by precedence climbing. In left to right mode
+   * every operator shares one level.
+   * @param level The lowest operator level this call may take.
+   * @return The index of the node.
+   * @throws An error if something went wrong.
+   */
+  int cSource::Parse_Expression(int level) {
+    int left = this->Parse_Operand();
+    while (this->Has_Token()) {
+      int oper = this->Get_Operator(this->Peek_Token());
+      if (oper == -1) {
+        break;
+      }
+      int oper_level = this->Get_Level(oper);
+      if (oper_level < level) {
+        break;
+      }
+      this->cursor++;
+      int right = this->Parse_Expression(oper_level + 1);
+      left = this->Make_Node(oper, left, right);
+    }
+    return left;
+  }
+
+  /**
+   * Parses a condition.
+   * @return The index of the node.
+   * @throws An error if the test is invalid.
+   */
+  int cSource::Parse_Condition() {
+    int left = this->Parse_Expression(1);
+    sScript_Token& test = this->Get_Token();
+    int opcode = this->Get_Test(test);
+    if (opcode == -1) {
+      this->Generate_Parse_Error("Invalid test " + this->Get_Text(test) + ".", test);
+    }
+    int right = this->Parse_Expression(1);
+    return this->Make_Node(opcode, left, right);
+  }
+
+  /**
+   * Parses conditions joined with logic. And binds tighter than or unless
+   * the script is compiled left to right.
+   * @param level The lowest logic level this call may take.
+   * @return The index of the node.
+   * @throws An error if a condition is invalid.
+   */
+  int cSource::Parse_Conditional(int level) {
+    int left = this->Parse_Condition();
+    while (this->Has_Token()) {
+      int logic = this->Get_Logic(this->Peek_Token());
+      if (logic == -1) {
+        break;
+      }
+      int logic_level = this->Get_Level(logic);
+      if (logic_level < level) {
+        break;
+      }
+      this->cursor++;
+      int right = this->Parse_Conditional(logic_level + 1);
+      left = this->Make_Node(logic, left, right);
+    }
+    return left;
+  }
+
+  /**
+   * Compiles the conditional of a block up to its opcode. The operands
+   * which follow the test are left to the caller. A single test of a
+   * variable against a constant or another variable is fused into one
+   * opcode when the block has one for it.
+   * @param opcode The opcode of the block which tests the value stack.
+   * @param const_opcode The fused opcode for a constant or -1 if none.
+   * @param vars_opcode The fused opcode for two variables or -1 if none.
+   * @throws An error if a condition is invalid.
+   */
+  void cSource::Compile_Conditional(int opcode, int const_opcode, int vars_opcode) {
+    this->nodes.clear();
+    int test = this->Parse_Conditional(1);
+    if (!this->Fuse_Test(const_opcode, test, eOPCODE_PUSH_CONST) &&
+        !this->Fuse_Test(vars_opcode, test, eOPCODE_PUSH_VAR)) {
+      this->Generate_Node(test);
+      this->Emit(opcode);
+    }
+  }
+
+  /**
+   * Emits a fused test if the test compares a variable on the left.
+   * @param opcode The fused opcode or -1 if there is none.
+   * @param test The index of the test node.
+   * @param right_opcode The leaf opcode the right side must have.
+   * @return True if the test was fused, false otherwise.
+   */
+  bool cSource::Fuse_Test(int opcode, int test, int right_opcode) {
+    if ((opcode == -1) || (this->options & eOPTION_NO_FUSE)) {
+      return false;
+    }
+    sNode& node = this->nodes[test];
+    if ((node.opcode < eOPCODE_EQUAL) || (node.opcode > eOPCODE_LESS_OR_EQUAL) ||
+        (this->nodes[node.left].opcode != eOPCODE_PUSH_VAR) ||
+        (this->nodes[node.right].opcode != right_opcode)) {
+      return false;
+    }
+    this->Emit(opcode, node.opcode, this->nodes[node.left].operands[0], this->nodes[node.right].operands[0]);
+    return true;
+  }
+
+  /**
+   * Emits a step if a store adds a constant to the variable it is stored
+   * in. The location is only taken when the store is fused.
+   * @param node_index The index of the node of the stored value.
+   * @return True if the store was fused, false otherwise.
+   */
+  bool cSource::Fuse_Step(int node_index) {
+    sNode& node = this->nodes[node_index];
+    if ((this->options & eOPTION_NO_FUSE) || (node.left == -1) ||
+        ((node.opcode != eOPCODE_ADD) && (node.opcode != eOPCODE_SUBTRACT))) {
+      return false;
+    }
+    sNode& left = this->nodes[node.left];
+    sNode& right = this->nodes[node.right];
+    int slot = -1;
+    int amount = 0;
+    if ((left.opcode == eOPCODE_PUSH_VAR) && (right.opcode == eOPCODE_PUSH_CONST)) {
+      slot = left.operands[0];
+      amount = (node.opcode == eOPCODE_ADD) ? right.operands[0] : -right.operands[0];
+    }
+    else if ((node.opcode == eOPCODE_ADD) && (left.opcode == eOPCODE_PUSH_CONST) && (right.opcode == eOPCODE_PUSH_VAR)) {
+      slot = right.operands[0];
+      amount = left.operands[0];
+    }
+    int index = this->cursor;
+    sScript_Token& location = this->Peek_Token();
+    if ((slot == -1) || (location.kind == eTOKEN_ACCESSOR) || (this->var_table.Resolve(this->Get_Text(location), index) != slot)) {
+      return false;
+    }
+    this->cursor++;
+    this->Note_Symbol(slot, false, 0);
+    this->Emit(eOPCODE_STEP, slot, amount);
+    return true;
+  }
+
+  /**
+   * Counts the fused opcodes in the code.
+   * @return The counts of each kind.
+   */
+  sFuse_Stats cSource::Count_Fusions() {
+    sFuse_Stats stats;
+    stats.steps = 0;
+    stats.if_tests = 0;
+    stats.loop_tests = 0;
+    int code_count = (int)this->code.size();
+    for (int code_index = 0; code_index < code_count; code_index += opcode_infos[this->code[code_index]].operand_count + 1) {
+      int opcode = this->code[code_index];
+      if (opcode == eOPCODE_STEP) {
+        stats.steps++;
+      }
+      else if (opcode == eOPCODE_IF_CONST) {
+        stats.if_tests++;
+      }
+      else if ((opcode == eOPCODE_WHILE_CONST) || (opcode == eOPCODE_WHILE_VARS)) {
+        stats.loop_tests++;
+      }
+    }
+    return stats;
+  }
+
+  /**
+   * Gets the precedence level of an operator or logic.
+   * @param opcode The opcode of the operator.
+   * @return The level. Higher levels bind tighter.
+   */
+  int cSource::Get_Level(int opcode) {
+    int level = 1;
+    if (!(this->options & eOPTION_LEFT_TO_RIGHT)) {
+      if ((opcode == eOPCODE_ADD) || (opcode == eOPCODE_SUBTRACT) || (opcode == eOPCODE_OR)) {
+        level = 1;
+      }
+      else {
+        level = 2;
+      }
+    }
+    return level;
+  }
+
+  /**
+   * Makes a leaf node.
+   * @param opcode The opcode of the leaf.
+   * @param token The index of the token of the leaf.
+   * @param operand_1 The first operand.
+   * @param operand_2 The second operand.
+   * @param operand_3 The third operand.
+   * @return The index of the node.
+   */
+  int cSource::Make_Leaf(int opcode, int token, int operand_1, int operand_2, int operand_3) {
+    sNode node;
+    node.opcode = opcode;
+    node.operands[0] = operand_1;
+    node.operands[1] = operand_2;
+    node.operands[2] = operand_3;
+    node.left = -1;
+    node.right = -1;
+    node.token = token;
+    this->nodes.push_back(node);
+    return (int)this->nodes.size() - 1;
+  }
+
+  /**
+   * Makes a node for an operator, test or logic. Constant operands are
+   * folded into a single constant leaf.
+   * @param opcode The opcode of the node.
+   * @param left The index of the left node.
+   * @param right The index of the right node.
+   * @return The index of the node.
+   */
+  int cSource::Make_Node(int opcode, int left, int right) {
+    int token = this->cursor - 1;
+    bool left_const = (this->nodes[left].opcode == eOPCODE_PUSH_CONST);
+    bool right_const = (this->nodes[right].opcode == eOPCODE_PUSH_CONST);
+    int left_value = this->nodes[left].operands[0];
+    int right_value = this->nodes[right].operands[0];
+    if ((opcode == eOPCODE_AND) || (opcode == eOPCODE_OR)) {
+      // Only drop a side which would never be evaluated or changes nothing.
+      if (left_const) {
+        if ((opcode == eOPCODE_AND) == (left_value != 0)) {
+          return right;
+        }
+        return this->Make_Leaf(eOPCODE_PUSH_CONST, token, (opcode == eOPCODE_OR), 0, 0);
+      }
+      if (right_const && ((opcode == eOPCODE_AND) == (right_value != 0))) {
+        return left;
+      }
+    }
+    else if (left_const && right_const) {
+      int result = 0;
+      if (this->Fold_Operator(opcode, left_value, right_value, result)) {
+        return this->Make_Leaf(eOPCODE_PUSH_CONST, token, result, 0, 0);
+      }
+    }
+    int node = this->Make_Leaf(opcode, token, 0, 0, 0);
+    this->nodes[node].left = left;
+    this->nodes[node].right = right;
+    return node;
+  }
+
+  /**
+   * Computes an operator or test on two constants the same way the
+   * interpreter would.
+   * @param opcode The opcode to compute.
+   * @param left The left value.
+   * @param right The right value.
+   * @param result Receives the result.
+   * @return True if the operator could be folded, false otherwise.
+   */
+  bool cSource::Fold_Operator(int opcode, int left, int right, int& result) {
+    bool folded = true;
+    int diff = (left - right);
+    switch (opcode) {
+      case eOPCODE_ADD:
+        result = left + right;
+        break;
+      case eOPCODE_SUBTRACT:
+        result = left - right;
+        break;
+      case eOPCODE_MULTIPLY:
+        result = left * right;
+        break;
+      case eOPCODE_DIVIDE:
+        folded = (right != 0);
+        result = folded ? (left / right) : 0;
+        break;
+      case eOPCODE_REMAINDER:
+        folded = (right != 0);
+        result = folded ? (left % right) : 0;
+        break;
+      case eOPCODE_COSINE:
+        result = (int)((double)left * std::cos((double)right * 3.14 / 180.0));
+        break;
+      case eOPCODE_SINE:
+        result = (int)((double)left * std::sin((double)right * 3.14 / 180.0));
+        break;
+      case eOPCODE_EQUAL:
+        result = (diff == 0);
+        break;
+      case eOPCODE_NOT_EQUAL:
+        result = (diff != 0);
+        break;
+      case eOPCODE_GREATER:
+        result = (diff > 0);
+        break;
+      case eOPCODE_LESS:
+        result = (diff < 0);
+        break;
+      case eOPCODE_GREATER_OR_EQUAL:
+        result = (diff >= 0);
+        break;
+      case eOPCODE_LESS_OR_EQUAL:
+        result = (diff <= 0);
+        break;
+      default: // Random numbers are never folded.
+        folded = false;
+        break;
+    }
+    return folded;
+  }
+
+  /**
+   * Emits the code of a node in postfix order. And and or jump over their
+   * right side once the left side decides the result.
+   * @param node_index The index of the node.
+   */
+  void cSource::Generate_Node(int node_index) {
+    sNode& node = this->nodes[node_index];
+    if (node.left == -1) { // Leaf
+      this->Emit_Word(node.opcode, node.token);
+      int operand_count = opcode_infos[node.opcode].operand_count;
+      for (int operand_index = 0; operand_index < operand_count; operand_index++) {
+        this->Emit_Word(node.operands[operand_index], node.token);
+      }
+    }
+    else if ((node.opcode == eOPCODE_AND) || (node.opcode == eOPCODE_OR)) {
+      this->Generate_Node(node.left);
+      this->Emit_Word(node.opcode, node.token);
+      this->Emit_Word(0, node.token);
+      int fixup = (int)this->code.size() - 1;
+      this->Generate_Node(node.right);
+      this->code[fixup] = (int)this->code.size();
+    }
+    else {
+      this->Generate_Node(node.left);
+      this->Generate_Node(node.right);
+      this->Emit_Word(node.opcode, node.token);
+    }
+  }
+
+  /**
+   * Records how a symbol is used during the first pass.
+   * @param slot The slot of the symbol.
+   * @param define True if the symbol is defined, false if written.
+   * @param value The defined value.
+   */
+  void cSource::Note_Symbol(int slot, bool define, int value) {
+    if (!this->fold_symbols) {
+      if (slot >= (int)this->symbols.size()) {
+        sSymbol_Info info;
+        info.defines = 0;
+        info.writes = 0;
+        info.value = 0;
+        this->symbols.resize(slot + 1, info);
+      }
+      if (define) {
+        this->symbols[slot].defines++;
+        this->symbols[slot].value = value;
+      }
+      else {
+        this->symbols[slot].writes++;
+      }
+    }
+  }
+
+  /**
+   * Determines if a symbol can be folded into a constant. That is the case
+   * when it is defined once and never written.
+   * @param slot The slot of the symbol.
+   * @return True if the symbol is constant, false otherwise.
+   */
+  bool cSource::Is_Constant(int slot) {
+    return (this->fold_symbols &&
+            (slot < (int)this->symbols.size()) &&
+            (this->symbols[slot].defines == 1) &&
+            (this->symbols[slot].writes == 0));
+  }
+
+  /**
+   * Gets the opcode of an operator.
+   * @param token The token to check.
+   * @return The opcode or -1 if the token is not an operator.
+   */
+  int cSource::Get_Operator(sScript_Token& token) {
+    int opcode = -1;
+    if ((token.kind == eTOKEN_OPERATOR) && (token.value >= eOPCODE_ADD) && (token.value <= eOPCODE_SINE)) {
+      opcode = token.value;
+    }
+    return opcode;
+  }
+
+  /**
+   * Gets the opcode of a test.
+   * @param token The token to check.
+   * @return The opcode or -1 if the token is not a test.
+   */
+  int cSource::Get_Test(sScript_Token& token) {
+    int opcode = -1;
+    if ((token.kind == eTOKEN_OPERATOR) && (token.value >= eOPCODE_EQUAL) && (token.value <= eOPCODE_LESS_OR_EQUAL)) {
+      opcode = token.value;
+    }
+    return opcode;
+  }
+
+  /**
+   * Gets the opcode of conditional logic.
+   * @param token The token to check.
+   * @return The opcode or -1 if the token is not logic.
+   */
+  int cSource::Get_Logic(sScript_Token& token) {
+    int opcode = -1;
+    if ((token.kind == eTOKEN_OPERATOR) && (token.value >= eOPCODE_AND) && (token.value <= eOPCODE_OR)) {
+      opcode = token.value;
+    }
+    return opcode;
+  }
+
+  /**
+   * Opens a block whose exit is resolved by the matching end. The exit
+   * operand must be the last one emitted.
+   * @param opcode The opcode which opened the block.
+   * @param token The index of the token which opened the block.
+   */
+  void cSource::Open_Block(int opcode, int token) {
+    sBlock block;
+    block.opcode = opcode;
+    block.fixup = (int)this->code.size() - 1;
+    block.token = token;
+    this->blocks.Push(block);
+  }
+
+  /**
+   * Emits a word of code.
+   * @param word The opcode or operand.
+   * @param token The index of the token which produced the word.
+   */
+  void cSource::Emit_Word(int word, int token) {
+    this->code.push_back(word);
+    this->code_tokens.push_back(token);
+  }
+
+  /**
+   * Emits an opcode with no operands.
+   * @param opcode The opcode.
+   */
+  void cSource::Emit(int opcode) {
+    this->Emit_Word(opcode, this->cursor - 1);
+  }
+
+  /**
+   * Emits an opcode with one operand.
+   * @param opcode The opcode.
+   * @param operand The operand.
+   */
+  void cSource::Emit(int opcode, int operand) {
+    this->Emit(opcode);
+    this->Emit_Word(operand, this->cursor - 1);
+  }
+
+  /**
+   * Emits an opcode with two operands.
+   * @param opcode The opcode.
+   * @param operand_1 The first operand.
+   * @param operand_2 The second operand.
+   */
+  void cSource::Emit(int opcode, int operand_1, int operand_2) {
+    this->Emit(opcode, operand_1);
+    this->Emit_Word(operand_2, this->cursor - 1);
+  }
+
+  /**
+   * Emits an opcode with three operands.
+   * @param opcode The opcode.
+   * @param operand_1 The first operand.
+   * @param operand_2 The second operand.
+   * @param operand_3 The third operand.
+   */
+  void cSource::Emit(int opcode, int operand_1, int operand_2, int operand_3) {
+    this->Emit(opcode, operand_1, operand_2);
+    this->Emit_Word(operand_3, this->cursor - 1);
+  }
+
+  /**
+   * Adds a token or text constant to the text pool. Duplicates share one
+   * entry.
+   * @param text The text to add.
+   * @return The ID of the text.
+   */
+  int cSource::Add_Text(std::string text) {
+    return this->texts.Intern(text);
+  }
+
+  // **************************************************************************
+  // Interpreter Implementation
+  // **************************************************************************
+
+  /**
+   * Interprets a single command. Expression opcodes work on a small value
+   * stack until the command opcode that ends the statement is reached.
+   * @throws An error if something went wrong.
+   */
+  void cSource::Interpret() {
+    int values[32]; // The draw command needs the deepest stack.
+    int top = 0;
+    while (true) {
+      int opcode = this->code[this->pointer++];
+      switch (opcode) {
+        case eOPCODE_PUSH_CONST:
+          values[top++] = this->code[this->pointer++];
+          break;
+        case eOPCODE_PUSH_VAR:
+          values[top++] = this->vars[this->code[this->pointer++]];
+          break;
+        case eOPCODE_PUSH_LIST: {
+          std::vector<int>& list = this->lists[this->code[this->pointer]];
+          int index = this->vars[this->code[this->pointer + 1]];
+#ifdef SAUSAGE_CHECK_BOUNDS
+          this->Check_Bounds(index, (int)list.size(), this->pointer);
+#endif
+          values[top++] = list[index];
+          this->pointer += 2;
+          break;
+        }
+        case eOPCODE_PUSH_MATRIX: {
+          int matrix = this->code[this->pointer];
+          int y = this->vars[this->code[this->pointer + 1]];
+          int x = this->vars[this->code[this->pointer + 2]];
+#ifdef SAUSAGE_CHECK_BOUNDS
+          this->Check_Bounds(y, this->matrices[matrix].height, this->pointer);
+          this->Check_Bounds(x, this->matrices[matrix].width, this->pointer);
+#endif
+          values[top++] = this->matrices[matrix].Get(x, y);
+          this->pointer += 3;
+          break;
+        }
+        case eOPCODE_GETKEY:
+          values[top++] = this->Read_Signal();
+          break;
+        case eOPCODE_WAITKEY: {
+          int signal = this->Read_Signal();
+          if (!signal) {
+            this->pointer--; // Poll again when resumed.
+            this->suspend = eSUSPEND_INPUT;
+            return;
+          }
+          values[top++] = signal;
+          break;
+        }
+        case eOPCODE_PROGRESS:
+          values[top++] = this->resource_io ? this->resource_io->Get_Load_Progress() : 100;
+          break;
+        case eOPCODE_SUM:
+        case eOPCODE_MINIMUM:
+        case eOPCODE_MAXIMUM:
+          values[top++] = this->Reduce(opcode, this->code[this->pointer], this->code[this->pointer + 1]);
+          this->pointer += 2;
+          break;
+        case eOPCODE_COLLIDE:
+          values[top++] = this->Collide(this->code[this->pointer], this->code[this->pointer + 1], this->code[this->pointer + 2]);
+          this->pointer += 3;
+          break;
+        case eOPCODE_NEAREST:
+          values[top - 1] = this->Find_Nearest(this->code[this->pointer], this->code[this->pointer + 1], this->code[this->pointer + 2], values[top - 1]);
+          this->pointer += 3;
+          break;
+        case eOPCODE_ADD:
+          top--;
+          values[top - 1] += values[top];
+          break;
+        case eOPCODE_SUBTRACT:
+          top--;
+          values[top - 1] -= values[top];
+          break;
+        case eOPCODE_MULTIPLY:
+          top--;
+          values[top - 1] *= values[top];
+          break;
+        case eOPCODE_DIVIDE:
+          top--;
+          values[top - 1] /= values[top];
+          break;
+        case eOPCODE_REMAINDER:
+          top--;
+          values[top - 1] %= values[top];
+          break;
+        case eOPCODE_RANDOM:
+          top--;
+          values[top - 1] = Next_Random(this->random_seed, values[top - 1], values[top]);
+          break;
+        case eOPCODE_COSINE:
+          top--;
+          values[top - 1] = (int)((double)values[top - 1] * std::cos((double)values[top] * 3.14 / 180.0));
+          break;
+        case eOPCODE_SINE:
+          top--;
+          values[top - 1] = (int)((double)values[top - 1] * std::sin((double)values[top] * 3.14 / 180.0));
+          break;
+        case eOPCODE_EQUAL:
+          top--;
+          values[top - 1] = ((values[top - 1] - values[top]) == 0);
+          break;
+        case eOPCODE_NOT_EQUAL:
+          top--;
+          values[top - 1] = ((values[top - 1] - values[top]) != 0);
+          break;
+        case eOPCODE_GREATER:
+          top--;
+          values[top - 1] = ((values[top - 1] - values[top]) > 0);
+          break;
+        case eOPCODE_LESS:
+          top--;
+          values[top - 1] = ((values[top - 1] - values[top]) < 0);
+          break;
+        case eOPCODE_GREATER_OR_EQUAL:
+          top--;
+          values[top - 1] = ((values[top - 1] - values[top]) >= 0);
+          break;
+        case eOPCODE_LESS_OR_EQUAL:
+          top--;
+          values[top - 1] = ((values[top - 1] - values[top]) <= 0);
+          break;
+        case eOPCODE_AND:
+          if (values[top - 1]) { // Right side decides.
+            top--;
+            this->pointer++;
+          }
+          else {
+            this->pointer = this->code[this->pointer]; // Already false.
+          }
+          break;
+        case eOPCODE_OR:
+          if (values[top - 1]) {
+            this->pointer = this->code[this->pointer]; // Already true.
+          }
+          else { // Right side decides.
+            top--;
+            this->pointer++;
+          }
+          break;
+        case eOPCODE_IF: {
+          int target = this->code[this->pointer++];
+          if (!values[--top]) {
+            this->pointer = target;
+          }
+          return;
+        }
+        case eOPCODE_ELSE:
+          this->pointer = this->code[this->pointer];
+          return;
+        case eOPCODE_END:
+          if (this->stack.Count() > 0) {
+            this->pointer = this->stack.Pop(); // Jump to saved position.
+          }
+          return;
+        case eOPCODE_WHILE: {
+          int start = this->code[this->pointer++];
+          int target = this->code[this->pointer++];
+          if (values[--top]) {
+            this->stack.Push(start); // Save start position of while.
+          }
+          else {
+            this->pointer = target;
+          }
+          return;
+        }
+        case eOPCODE_SUBROUTINE:
+          this->pointer = this->code[this->pointer + 1]; // We jump over subroutines.
+          return;
+        case eOPCODE_CALL: {
+          int target = this->code[this->pointer++];
+          this->stack.Push(this->pointer); // Save the return address.
+          this->pointer = target;
+          return;
+        }
+        case eOPCODE_STORE_VAR:
+          this->vars[this->code[this->pointer++]] = values[--top];
+          return;
+        case eOPCODE_SNAPSHOT: {
+          std::ofstream file(this->Get_File_Name(this->texts[this->code[this->pointer++]], false).c_str(), std::ios::binary | std::ios::trunc);
+          this->Save_Snapshot(file, false); // Resumes after this statement.
+          return;
+        }
+        case eOPCODE_RESTORE: {
+          std::ifstream file(this->Get_File_Name(this->texts[this->code[this->pointer++]], true).c_str(), std::ios::binary);
+          this->Load_Snapshot(file); // Carries on if there is nothing to restore.
+          return;
+        }
+        case eOPCODE_STEP:
+          this->vars[this->code[this->pointer]] += this->code[this->pointer + 1];
+          this->pointer += 2;
+          return;
+        case eOPCODE_IF_CONST: {
+          const int* operands = &this->code[this->pointer];
+          this->pointer = Compare_Values(operands[0], this->vars[operands[1]], operands[2]) ? (this->pointer + 4) : operands[3];
+          return;
+        }
+        case eOPCODE_WHILE_CONST:
+        case eOPCODE_WHILE_VARS: {
+          const int* operands = &this->code[this->pointer];
+          int right = (opcode == eOPCODE_WHILE_CONST) ? operands[2] : this->vars[operands[2]];
+          if (Compare_Values(operands[0], this->vars[operands[1]], right)) {
+            this->stack.Push(operands[3]); // Save start position of while.
+            this->pointer += 5;
+          }
+          else {
+            this->pointer = operands[4];
+          }
+          return;
+        }
+        case eOPCODE_STORE_LIST: {
+          std::vector<int>& list = this->lists[this->code[this->pointer]];
+          int index = this->vars[this->code[this->pointer + 1]];
+#ifdef SAUSAGE_CHECK_BOUNDS
+          this->Check_Bounds(index, (int)list.size(), this->pointer);
+#endif
+          list[index] = values[--top];
+          this->pointer += 2;
+          return;
+        }
+        case eOPCODE_STORE_MATRIX: {
+          int matrix = this->code[this->pointer];
+          int y = this->vars[this->code[this->pointer + 1]];
+          int x = this->vars[this->code[this->pointer + 2]];
+#ifdef SAUSAGE_CHECK_BOUNDS
+          this->Check_Bounds(y, this->matrices[matrix].height, this->pointer);
+          this->Check_Bounds(x, this->matrices[matrix].width, this->pointer);
+#endif
+          this->matrices[matrix].Get(x, y) = values[--top];
+          this->pointer += 3;
+          return;
+        }
+        case eOPCODE_OUTPUT:
+        case eOPCODE_NUMBER: {
+          top -= 5;
+          int slot = this->code[this->pointer++];
+          std::string text = (opcode == eOPCODE_OUTPUT) ? this->strings[slot] : Number_To_Text(this->vars[slot]);
+          if (this->options & eOPTION_RETAINED) {
+            this->Retain(eDISPLAY_TEXT, -1, text, values + top, 5);
+          }
+          else {
+            this->Flush_Draws(); // Text goes over the images drawn before it.
+            this->io->Output_Text(text, values[top], values[top + 1], values[top + 2], values[top + 3], values[top + 4]);
+          }
+          return;
+        }
+        case eOPCODE_DEFINE: {
+          int slot = this->code[this->pointer++];
+          this->vars[slot] = this->code[this->pointer++];
+          return;
+        }
+        case eOPCODE_VAR: {
+          int slot = this->code[this->pointer++];
+          this->vars[slot] = this->var_presets[slot];
+          return;
+        }
+        case eOPCODE_LIST:
+          this->lists[this->code[this->pointer++]].assign(values[--top], 0);
+          return;
+        case eOPCODE_MATRIX: {
+          int matrix = this->code[this->pointer++];
+          top -= 2;
+          this->matrices[matrix] = cFlat_Matrix(values[top], values[top + 1]);
+          return;
+        }
+        case eOPCODE_STRING: {
+          int slot = this->code[this->pointer++];
+          this->strings[slot] = this->texts[this->code[this->pointer++]];
+          return;
+        }
+        case eOPCODE_LOAD: {
+          int slot = this->code[this->pointer++];
+          std::string name = this->Get_File_Name(this->texts[this->code[this->pointer++]], true);
+          if (cFlat_Matrix::Is_Binary(name)) {
+            this->matrices[slot].Map_Binary(name);
+          }
+          else {
+            cMatrix matrix(this->matrices[slot].width, this->matrices[slot].height);
+            this->matrices[slot].To_Matrix(matrix); // Cells the file leaves out keep their values.
+            this->io->Load(name, matrix);
+            this->matrices[slot].From_Matrix(matrix);
+          }
+          return;
+        }
+        case eOPCODE_LOAD_WINDOW: {
+          int slot = this->code[this->pointer++];
+          std::string name = this->Get_File_Name(this->texts[this->code[this->pointer++]], true);
+          top -= 2;
+          if (!cFlat_Matrix::Is_Binary(name)) {
+            throw cError("Map " + name + " must be binary to load a window of it.");
+          }
+          this->matrices[slot].Load_Binary_Window(name, values[top], values[top + 1]);
+          return;
+        }
+        case eOPCODE_SAVE: {
+          int slot = this->code[this->pointer++];
+          std::string name = this->Get_File_Name(this->texts[this->code[this->pointer++]], false);
+          if (Is_Binary_Name(name)) {
+            this->matrices[slot].Save_Binary(name);
+          }
+          else {
+            cMatrix matrix(this->matrices[slot].width, this->matrices[slot].height);
+            this->matrices[slot].To_Matrix(matrix);
+            this->io->Save(name, matrix);
+          }
+          return;
+        }
+        case eOPCODE_DRAW:
+          top -= 7;
+          if (this->options & eOPTION_RETAINED) {
+            this->Retain(eDISPLAY_DRAW, this->code[this->pointer++], "", values + top, 7);
+          }
+          else {
+            this->Queue_Draw(this->code[this->pointer++], values + top);
+          }
+          return;
+        case eOPCODE_SOUND:
+          this->io->Play_Sound(this->texts[this->code[this->pointer++]]);
+          return;
+        case eOPCODE_MUSIC:
+          this->io->Play_Music(this->texts[this->code[this->pointer++]]);
+          return;
+        case eOPCODE_SILENCE:
+          this->io->Silence();
+          return;
+        case eOPCODE_REFRESH:
+          if (this->options & eOPTION_RETAINED) {
+            this->Present_Display();
+          }
+          else {
+            this->Flush_Draws();
+            this->io->Refresh();
+          }
+          this->draw_stats.frames++;
+          this->draw_stats.frame_draw_calls = 0;
+          this->draw_stats.frame_batches = 0;
+          return;
+        case eOPCODE_COLOR:
+          top -= 3;
+          if (this->options & eOPTION_RETAINED) {
+            this->Retain(eDISPLAY_COLOR, -1, "", values + top, 3);
+          }
+          else {
+            this->Flush_Draws();
+            this->io->Color(values[top], values[top + 1], values[top + 2]);
+          }
+          return;
+        case eOPCODE_FILL:
+        case eOPCODE_ADD_TO:
+        case eOPCODE_MULTIPLY_BY:
+          this->Apply(opcode, this->code[this->pointer], this->code[this->pointer + 1], values[--top]);
+          this->pointer += 2;
+          return;
+        case eOPCODE_COPY:
+          this->Copy(this->code[this->pointer], this->code[this->pointer + 1], this->code[this->pointer + 2]);
+          this->pointer += 3;
+          return;
+        case eOPCODE_BLIT:
+          top -= 6;
+          this->Blit(this->code[this->pointer], this->code[this->pointer + 1], values + top);
+          this->pointer += 2;
+          return;
+        case eOPCODE_YIELD:
+          this->suspend = eSUSPEND_FRAME;
+          return;
+        case eOPCODE_WAIT:
+          this->wake_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(values[--top]);
+          this->suspend = eSUSPEND_TIME;
+          return;
+        case eOPCODE_STOP:
+          this->Flush_Draws();
+          this->status = eSTATUS_DONE;
+          return;
+        default:
+          this->pointer--; // Stay on the end of the program.
+          throw cError("No more tokens left!");
+      }
+    }
+  }
+
+  /**
+   * Gets the number of rows in a list or matrix. A list is a single row.
+   * @param kind The kind of container.
+   * @param slot The slot of the container.
+   * @param width Receives the number of values in a row.
+   * @return The number of rows.
+   */
+  int cSource::Get_Rows(int kind, int slot, int& width) {
+    int rows = 1;
+    if (kind == eCONTAINER_LIST) {
+      width = (int)this->lists[slot].size();
+    }
+    else {
+      width = this->matrices[slot].width;
+      rows = this->matrices[slot].height;
+    }
+    return (width > 0) ? rows : 0;
+  }
+
+  /**
+   * Gets a row of a list or matrix.
+   * @param kind The kind of container.
+   * @param slot The slot of the container.
+   * @param row The row. Must be below the number of rows.
+   * @return The values in the row.
+   */
+  int* cSource::Get_Row(int kind, int slot, int row) {
+    if (kind == eCONTAINER_LIST) {
+      return &this->lists[slot][0];
+    }
+    return this->matrices[slot][row];
+  }
+
+  /**
+   * Gets all the values of a list or matrix as one run.
+   * @param kind The kind of container.
+   * @param slot The slot of the container.
+   * @param count Receives the number of values.
+   * @return The values.
+   */
+  int* cSource::Get_Values(int kind, int slot, int& count) {
+    int* values = NULL;
+    if (kind == eCONTAINER_LIST) {
+      count = (int)this->lists[slot].size();
+      values = this->lists[slot].data();
+    }
+    else {
+      count = this->matrices[slot].Count();
+      values = this->matrices[slot].cells;
+    }
+    return values;
+  }
+
+  /**
+   * Fills, adds to or multiplies every value of a list or matrix.
+   * @param opcode The bulk opcode.
+   * @param kind The kind of container.
+   * @param slot The slot of the container.
+   * @param value The value to apply.
+   */
+  void cSource::Apply(int opcode, int kind, int slot, int value) {
+    int count = 0;
+    int* values = this->Get_Values(kind, slot, count);
+    if (opcode == eOPCODE_FILL) {
+      Fill_Values(values, count, value);
+    }
+    else if (opcode == eOPCODE_ADD_TO) {
+      Add_Values(values, count, value);
+    }
+    else {
+      Multiply_Values(values, count, value);
+    }
+  }
+
+  /**
+   * Sums or finds the least or greatest value of a list or matrix.
+   * @param opcode The reduction opcode.
+   * @param kind The kind of container.
+   * @param slot The slot of the container.
+   * @return The result or zero if the container is empty.
+   */
+  int cSource::Reduce(int opcode, int kind, int slot) {
+    int count = 0;
+    int* values = this->Get_Values(kind, slot, count);
+    int result = 0;
+    if (opcode == eOPCODE_SUM) {
+      result = Sum_Values(values, count);
+    }
+    else if (count > 0) {
+      result = (opcode == eOPCODE_MINIMUM) ? Minimum_Value(values, count, values[0]) : Maximum_Value(values, count, values[0]);
+    }
+    return result;
+  }
+
+
+  /**
+   * Copies one list or matrix over another as far as both reach.
+   * @param kind The kind of container.
+   * @param source The slot of the source.
+   * @param dest The slot of the destination.
+   */
+  void cSource::Copy(int kind, int source, int dest) {
+    if (source == dest) {
+      return;
+    }
+    int source_width = 0;
+    int dest_width = 0;
+    int rows = std::min(this->Get_Rows(kind, source, source_width), this->Get_Rows(kind, dest, dest_width));
+    int width = std::min(source_width, dest_width);
+    if (source_width == dest_width) { // Rows follow each other in both.
+      width *= rows;
+      rows = std::min(rows, 1);
+    }
+    for (int row = 0; row < rows; row++) {
+      std::memcpy(this->Get_Row(kind, dest, row), this->Get_Row(kind, source, row), width * sizeof(int));
+    }
+  }
+
+  /**
+   * Copies a rectangle from one matrix to another. The rectangle is clipped
+   * to both matrices and may overlap itself when both are the same.
+   * @param source The slot of the source matrix.
+   * @param dest The slot of the destination matrix.
+   * @param values The source x, y, width, height and destination x, y.
+   */
+  void cSource::Blit(int source, int dest, int* values) {
+    int source_x = values[0];
+    int source_y = values[1];
+    int width = values[2];
+    int height = values[3];
+    int dest_x = values[4];
+    int dest_y = values[5];
+    int clip = std::max(-source_x, -dest_x); // Clip left and top.
+    if (clip > 0) {
+      source_x += clip;
+      dest_x += clip;
+      width -= clip;
+    }
+    clip = std::max(-source_y, -dest_y);
+    if (clip > 0) {
+      source_y += clip;
+      dest_y += clip;
+      height -= clip;
+    }
+    width = std::min(width, std::min(this->matrices[source].width - source_x, this->matrices[dest].width - dest_x));
+    height = std::min(height, std::min(this->matrices[source].height - source_y, this->matrices[dest].height - dest_y));
+    if ((width <= 0) || (height <= 0)) {
+      return;
+    }
+    bool upward = (source == dest) && (dest_y > source_y); // Copy bottom rows first so overlap is safe.
+    for (int row_index = 0; row_index < height; row_index++) {
+      int row = upward ? (height - 1 - row_index) : row_index;
+      int* from = &this->matrices[source].Get(source_x, source_y + row);
+      int* to = &this->matrices[dest].Get(dest_x, dest_y + row);
+      std::memmove(to, from, width * sizeof(int));
+    }
+  }
+
+  /**
+   * Gets the object records held in a list or matrix.
+   * @param kind The kind of container.
+   * @param slot The slot of the container.
+   * @param stride Receives the number of values from one record to the next.
+   * @param count Receives the number of records.
+   * @return The first record.
+   */
+  int* cSource::Get_Records(int kind, int slot, int& stride, int& count) {
+    int width = 0;
+    int rows = this->Get_Rows(kind, slot, width);
+    int* records = this->Get_Values(kind, slot, count);
+    stride = (kind == eCONTAINER_LIST) ? (int)eRECORD_SIZE : width;
+    count = (stride >= eRECORD_SIZE) ? ((kind == eCONTAINER_LIST) ? (count / stride) : rows) : 0;
+    return records;
+  }
+
+  /**
+   * Finds every pair of overlapping objects using a spatial grid sized to
+   * the objects. Each pair is written to the result list as the lower
+   * record index then the higher. Edges are worked out in long long since
+   * a box may reach past the range of an int. Pairs are held until the
+   * sweep is done since the result list may also hold the records.
+   * @param kind The kind of container holding the records.
+   * @param slot The slot of the container.
+   * @param result The slot of the result list.
+   * @return The number of pairs found. Only as many as fit are written.
+   */
+  int cSource::Collide(int kind, int slot, int result) {
+    int stride = 0;
+    int object_count = 0;
+    int* records = this->Get_Records(kind, slot, stride, object_count);
+    long long extent = 0;
+    for (int object = 0; object < object_count; object++) {
+      int* box = records + (object * stride);
+      extent += std::max(std::max(box[eRECORD_WIDTH], box[eRECORD_HEIGHT]), 0);
+    }
+    this->grid.Reset((int)std::max(extent / std::max(object_count, 1), 1LL), object_count);
+    std::vector<int>& pairs = this->grid.pairs;
+    int room = this->lists[result].size() / 2;
+    int pair_count = 0;
+    pairs.clear();
+    for (int object = 0; object < object_count; object++) {
+      int* box = records + (object * stride);
+      if ((box[eRECORD_WIDTH] <= 0) || (box[eRECORD_HEIGHT] <= 0)) {
+        continue; // Covers nothing.
+      }
+      long long right = (long long)box[eRECORD_X] + box[eRECORD_WIDTH];
+      long long bottom = (long long)box[eRECORD_Y] + box[eRECORD_HEIGHT];
+      int last_x = this->grid.Get_Cell(right - 1);
+      int last_y = this->grid.Get_Cell(bottom - 1);
+      for (int cell_y = this->grid.Get_Cell(box[eRECORD_Y]); cell_y <= last_y; cell_y++) {
+        for (int cell_x = this->grid.Get_Cell(box[eRECORD_X]); cell_x <= last_x; cell_x++) {
+          for (int entry = this->grid.heads[this->grid.Find_Bucket(cell_x, cell_y)]; entry != -1; entry = this->grid.entries[entry].next) {
+            sGrid_Entry& other = this->grid.entries[entry];
+            if ((other.cell_x != cell_x) || (other.cell_y != cell_y)) {
+              continue; // Another cell in the same bucket.
+            }
+            int* other_box = records + (other.object * stride);
+            int overlap_left = std::max(box[eRECORD_X], other_box[eRECORD_X]);
+            int overlap_top = std::max(box[eRECORD_Y], other_box[eRECORD_Y]);
+            if ((overlap_left < std::min(right, (long long)other_box[eRECORD_X] + other_box[eRECORD_WIDTH])) &&
+                (overlap_top < std::min(bottom, (long long)other_box[eRECORD_Y] + other_box[eRECORD_HEIGHT])) &&
+                (this->grid.Get_Cell(overlap_left) == cell_x) && (this->grid.Get_Cell(overlap_top) == cell_y)) { // Counted once, in the cell of the overlap corner.
+              if (pair_count < room) {
+                pairs.push_back(other.object);
+                pairs.push_back(object);
+              }
+              pair_count++;
+            }
+          }
+        }
+      }
+      this->grid.Insert(object, box[eRECORD_X], box[eRECORD_Y], right, bottom);
+    }
+    std::copy(pairs.begin(), pairs.end(), this->lists[result].begin());
+    return pair_count;
+  }
+
+  /**
+   * Finds the nearest other object to each object, measured between their
+   * centers, using a spatial grid with cells as large as the search
+   * radius. The result list gets the record index of the nearest object
+   * within the radius, or -1 if there is none, at the index of each record
+   * it has room for. Ties go to the lower index. Centers are worked out in
+   * long long so that the radius can reach past the range of an int.
+   * Every record is read before any result is written, so the result list
+   * may also hold the records.
+   * @param kind The kind of container holding the records.
+   * @param slot The slot of the container.
+   * @param result The slot of the result list.
+   * @param radius The search radius.
+   * @return The number of objects with a neighbor within the radius.
+   */
+  int cSource::Find_Nearest(int kind, int slot, int result, int radius) {
+    int stride = 0;
+    int object_count = 0;
+    int* records = this->Get_Records(kind, slot, stride, object_count);
+    this->grid.Reset(std::max(radius, 1), object_count);
+    std::vector<long long> centers(object_count * 2);
+    for (int object = 0; object < object_count; object++) {
+      int* box = records + (object * stride);
+      centers[object * 2] = (long long)box[eRECORD_X] + (box[eRECORD_WIDTH] / 2);
+      centers[(object * 2) + 1] = (long long)box[eRECORD_Y] + (box[eRECORD_HEIGHT] / 2);
+      this->grid.Insert(object, centers[object * 2], centers[(object * 2) + 1], centers[object * 2] + 1, centers[(object * 2) + 1] + 1);
+    }
+    std::vector<int>& nearest = this->lists[result];
+    int found_count = 0;
+    long long reach = (long long)radius * radius;
+    for (int object = 0; object < object_count; object++) {
+      long long x = centers[object * 2];
+      long long y = centers[(object * 2) + 1];
+      int best = -1;
+      long long best_distance = 0;
+      int last_x = this->grid.Get_Cell(x + radius);
+      int last_y = this->grid.Get_Cell(y + radius);
+      for (int cell_y = this->grid.Get_Cell(y - radius); cell_y <= last_y; cell_y++) {
+        for (int cell_x = this->grid.Get_Cell(x - radius); cell_x <= last_x; cell_x++) {
+          for (int entry = this->grid.heads[this->grid.Find_Bucket(cell_x, cell_y)]; entry != -1; entry = this->grid.entries[entry].next) {
+            sGrid_Entry& other = this->grid.entries[entry];
+            if ((other.object == object) || (other.cell_x != cell_x) || (other.cell_y != cell_y)) {
+              continue;
+            }
+            long long delta_x = centers[other.object * 2] - x;
+            long long delta_y = centers[(other.object * 2) + 1] - y;
+            long long distance = (delta_x * delta_x) + (delta_y * delta_y);
+            if ((distance <= reach) && ((best == -1) || (distance < best_distance) || ((distance == best_distance) && (other.object < best)))) {
+              best = other.object;
+              best_distance = distance;
+            }
+          }
+        }
+      }
+      if (object < (int)nearest.size()) {
+        nearest[object] = best;
+      }
+      if (best != -1) {
+        found_count++;
+      }
+    }
+    return found_count;
+  }
+
+  /**
+   * Queues an image draw for the frame. Each draw joins the earliest batch
+   * of its image with no overlapping batch after it, so overlapping draws
+   * keep their order whatever their images.
+   * @param image The text id of the image name.
+   * @param values The x, y, width, height, angle and flips.
+   */
+  void cSource::Queue_Draw(int image, int* values) {
+    sDraw draw;
+    draw.image = image;
+    draw.x = values[0];
+    draw.y = values[1];
+    draw.width = values[2];
+    draw.height = values[3];
+    draw.angle = values[4];
+    draw.flip_x = values[5];
+    draw.flip_y = values[6];
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+    Get_Draw_Bounds(values, left, top, right, bottom);
+    draw.batch = -1;
+    for (int batch_index = (int)this->batches.size() - 1; batch_index >= 0; batch_index--) {
+      sDraw_Batch& batch = this->batches[batch_index];
+      if (batch.image == image) {
+        draw.batch = batch_index;
+      }
+      if ((left < batch.right) && (right > batch.left) && (top < batch.bottom) && (bottom > batch.top)) {
+        break; // Cannot move ahead of this batch.
+      }
+    }
+    if (draw.batch == -1) {
+      sDraw_Batch batch;
+      batch.image = image;
+      batch.left = left;
+      batch.top = top;
+      batch.right = right;
+      batch.bottom = bottom;
+      batch.count = 0;
+      draw.batch = (int)this->batches.size();
+      this->batches.push_back(batch);
+    }
+    sDraw_Batch& batch = this->batches[draw.batch];
+    batch.left = std::min(batch.left, left);
+    batch.top = std::min(batch.top, top);
+    batch.right = std::max(batch.right, right);
+    batch.bottom = std::max(batch.bottom, bottom);
+    batch.count++;
+    this->draws.push_back(draw);
+  }
+
+  /**
+   * Adds a command to the frame being retained.
+   * @param type The type of the command.
+   * @param image The ID of the image or -1 if it is not a draw.
+   * @param text The text or an empty string if it is not text.
+   * @param values The values of the command.
+   * @param count The number of values.
+   */
+  void cSource::Retain(int type, int image, std::string text, const int* values, int count) {
+    sDisplay_Item item;
+    item.type = type;
+    item.image = image;
+    item.text = text;
+    std::fill(item.values, item.values + 7, 0);
+    std::copy(values, values + count, item.values);
+    if (type == eDISPLAY_DRAW) {
+      Get_Draw_Bounds(values, item.left, item.top, item.right, item.bottom);
+    }
+    else if (type == eDISPLAY_TEXT) {
+      item.left = values[0];
+      item.top = values[1];
+      item.right = eSCREEN_EDGE;
+      item.bottom = values[1] + eTEXT_BAND_HEIGHT;
+    }
+    else { // The whole screen.
+      item.left = -eSCREEN_EDGE;
+      item.top = -eSCREEN_EDGE;
+      item.right = eSCREEN_EDGE;
+      item.bottom = eSCREEN_EDGE;
+    }
+    this->display_list.push_back(item);
+  }
+
+  /**
+   * Compares the retained frame with the one on the screen and finds the
+   * area covered by every command which changed, appeared or went away.
+   * @param left Receives the left of the damaged area.
+   * @param top Receives the top of the damaged area.
+   * @param right Receives the right of the damaged area.
+   * @param bottom Receives the bottom of the damaged area.
+   * @return True if anything changed, false otherwise.
+   */
+  bool cSource::Find_Damage(int& left, int& top, int& right, int& bottom) {
+    bool damaged = false;
+    int new_count = this->display_list.size();
+    int old_count = this->shown_list.size();
+    int item_count = std::max(new_count, old_count);
+    for (int item_index = 0; item_index < item_count; item_index++) {
+      sDisplay_Item* items[2] = {
+        (item_index < new_count) ? &this->display_list[item_index] : NULL,
+        (item_index < old_count) ? &this->shown_list[item_index] : NULL
+      };
+      if (items[0] && items[1] && (items[0]->type == items[1]->type) && (items[0]->image == items[1]->image) &&
+          std::equal(items[0]->values, items[0]->values + 7, items[1]->values) && (items[0]->text == items[1]->text)) {
+        continue;
+      }
+      for (int side = 0; side < 2; side++) {
+        if (items[side]) {
+          left = damaged ? std::min(left, items[side]->left) : items[side]->left;
+          top = damaged ? std::min(top, items[side]->top) : items[side]->top;
+          right = damaged ? std::max(right, items[side]->right) : items[side]->right;
+          bottom = damaged ? std::max(bottom, items[side]->bottom) : items[side]->bottom;
+          damaged = true;
+        }
+      }
+    }
+    return damaged;
+  }
+
+  /**
+   * Shows the retained frame. A frame which matches the one on the screen
+   * is not drawn at all. An I/O control which supports regions keeps the
+   * frame itself, so only the commands over the damaged area are drawn
+   * again, clipped to it. Otherwise the whole frame is drawn.
+   */
+  void cSource::Present_Display() {
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+    if (!this->Find_Damage(left, top, right, bottom)) {
+      this->draw_stats.skipped_frames++;
+    }
+    else {
+      bool partial = (this->region_io != NULL) && !this->shown_list.empty() && ((left > -eSCREEN_EDGE) || (top > -eSCREEN_EDGE) ||
+        (right < eSCREEN_EDGE) || (bottom < eSCREEN_EDGE));
+      if (!partial) { // The whole screen.
+        left = -eSCREEN_EDGE;
+        top = -eSCREEN_EDGE;
+        right = eSCREEN_EDGE;
+        bottom = eSCREEN_EDGE;
+      }
+      if (this->region_io && !this->region_io->Begin_Region(left, top, right, bottom)) {
+        partial = false; // Nothing was kept.
+      }
+      if (partial) {
+        this->draw_stats.partial_frames++;
+      }
+      int item_count = this->display_list.size();
+      for (int item_index = 0; item_index < item_count; item_index++) {
+        sDisplay_Item& item = this->display_list[item_index];
+        if (partial && ((item.right <= left) || (item.left >= right) || (item.bottom <= top) || (item.top >= bottom))) {
+          continue; // Still on the screen.
+        }
+        if (item.type == eDISPLAY_DRAW) {
+          this->Queue_Draw(item.image, item.values);
+        }
+        else if (item.type == eDISPLAY_TEXT) {
+          this->Flush_Draws();
+          this->io->Output_Text(item.text, item.values[0], item.values[1], item.values[2], item.values[3], item.values[4]);
+        }
+        else {
+          this->Flush_Draws();
+          this->io->Color(item.values[0], item.values[1], item.values[2]);
+        }
+      }
+      this->Flush_Draws();
+      if (this->region_io) {
+        this->region_io->End_Region();
+      }
+      this->io->Refresh();
+    }
+    this->shown_list.swap(this->display_list);
+    this->display_list.clear();
+  }
+
+  /**
+   * Draws the queued images batch by batch.
+   */
+  void cSource::Flush_Draws() {
+    int batch_count = (int)this->batches.size();
+    if (batch_count == 0) {
+      return;
+    }
+    int start = 0;
+    for (int batch_index = 0; batch_index < batch_count; batch_index++) { // Where each batch starts.
+      int count = this->batches[batch_index].count;
+      this->batches[batch_index].count = start;
+      start += count;
+    }
+    int draw_count = (int)this->draws.size();
+    this->draw_order.resize(draw_count);
+    for (int draw_index = 0; draw_index < draw_count; draw_index++) {
+      this->draw_order[this->batches[this->draws[draw_index].batch].count++] = draw_index;
+    }
+    int order_index = 0;
+    for (int batch_index = 0; batch_index < batch_count; batch_index++) {
+      std::string& image = this->texts[this->batches[batch_index].image];
+      if (this->batch_io) {
+        this->batch_io->Begin_Batch();
+      }
+      for (; order_index < this->batches[batch_index].count; order_index++) {
+        sDraw& draw = this->draws[this->draw_order[order_index]];
+        this->io->Draw_Image(image, draw.x, draw.y, draw.width, draw.height, draw.angle, (bool)draw.flip_x, (bool)draw.flip_y);
+      }
+      if (this->batch_io) {
+        this->batch_io->End_Batch();
+      }
+    }
+    this->draw_stats.frame_draw_calls += draw_count;
+    this->draw_stats.frame_batches += batch_count;
+    this->draw_stats.draw_calls += draw_count;
+    this->draw_stats.batches += batch_count;
+    this->draws.clear();
+    this->batches.clear();
+  }
+
+  /**
+   * Checks that an index lies inside a list or matrix. Only compiled in
+   * when bounds checking is switched on.
+   * @param index The index to check.
+   * @param size The size of the dimension.
+   * @param position The code position of the accessor.
+   * @throws An error if the index is out of range.
+   */
+  void cSource::Check_Bounds(int index, int size, int position) {
+    if ((index < 0) || (index >= size)) {
+      this->Generate_Parse_Error("Index " + Number_To_Text(index) + " is out of range.", this->tokens[this->code_tokens[position]]);
+    }
+  }
+
+  /**
+   * Sets the value a variable starts with when it is declared.
+   * @param name The name of the variable.
+   * @param value The value.
+   * @return True if the program has the variable.
+   */
+  bool cSource::Preset_Var(std::string name, int value) {
+    int slot = this->var_table.Find(name);
+    if (slot != -1) {
+      this->vars[slot] = value;
+      this->var_presets[slot] = value;
+    }
+    return (slot != -1);
+  }
+
+  /**
+   * Gets the name of a file the script saves or loads. Pooled instances
+   * put their suffix before the extension so they do not write over each
+   * other. Loads fall back to the shared file if the instance has not
+   * written its own.
+   * @param name The name the script gave.
+   * @param reading True if the file will be read, false if written.
+   * @return The name of the file to use.
+   */
+  std::string cSource::Get_File_Name(std::string name, bool reading) {
+    if (this->file_suffix.empty()) {
+      return name;
+    }
+    std::string::size_type dot = name.find_last_of('.');
+    std::string::size_type folder = name.find_last_of("/\\");
+    if ((dot == std::string::npos) || ((folder != std::string::npos) && (dot < folder))) {
+      dot = name.length();
+    }
+    std::string own_name = name.substr(0, dot) + this->file_suffix + name.substr(dot);
+    if (reading && !std::ifstream(own_name.c_str()).good()) {
+      return name;
+    }
+    return own_name;
+  }
+
+  /**
+   * Gets a variable or symbol by name. Used for diagnostics.
+   * @param name The name of the variable.
+   * @return The value of the variable.
+   * @throws An error if the variable does not exist.
+   */
+  int& cSource::Get_Var(std::string name) {
+    int slot = this->var_table.Find(name);
+    if (slot == -1) {
+      throw cError("Symbol " + name + " was not found.");
+    }
+    return this->vars[slot];
+  }
+
+  // **************************************************************************
+  // Batched Allegro I/O Implementation
+  // **************************************************************************
+
+  /**
+   * Creates an Allegro I/O control which holds bitmap drawing per batch.
+   * @param title The title of the window.
+   * @param width The width of the screen.
+   * @param height The height of the screen.
+   * @param scale The scale of the screen.
+   * @param font The name of the font.
+   */
+  cBatched_Allegro_IO::cBatched_Allegro_IO(std::string title, int width, int height, int scale, std::string font) :
+    cAllegro_IO(title, width, height, scale, font) {
+    this->canvas = NULL;
+    this->screen = NULL;
+    this->run_evictions = 0;
+    this->atlas_evictions = 0;
+    this->text_clock = 0;
+    this->text_stats.run_hits = 0;
+    this->text_stats.run_misses = 0;
+    this->text_stats.digit_hits = 0;
+    this->text_stats.digit_misses = 0;
+  }
+
+  /**
+   * Starts holding draws of an image.
+   */
+  void cBatched_Allegro_IO::Begin_Batch() {
+    al_hold_bitmap_drawing(true);
+  }
+
+  /**
+   * Draws the held images.
+   */
+  void cBatched_Allegro_IO::End_Batch() {
+    al_hold_bitmap_drawing(false);
+  }
+
+  /**
+   * Starts drawing a region of the retained frame. The frame lives in a
+   * canvas of our own since the screen buffer is not kept after a flip.
+   * Drawing goes to the canvas, with the screen transform, clipped to the
+   * region.
+   * @param left The left edge.
+   * @param top The top edge.
+   * @param right The right edge.
+   * @param bottom The bottom edge.
+   * @return False if the canvas was just made and the whole frame has to
+   * be drawn.
+   */
+  bool cBatched_Allegro_IO::Begin_Region(int left, int top, int right, int bottom) {
+    this->screen = al_get_target_bitmap();
+    int width = al_get_bitmap_width(this->screen);
+    int height = al_get_bitmap_height(this->screen);
+    if (this->canvas && ((al_get_bitmap_width(this->canvas) != width) || (al_get_bitmap_height(this->canvas) != height))) {
+      al_destroy_bitmap(this->canvas);
+      this->canvas = NULL;
+    }
+    ALLEGRO_TRANSFORM transform;
+    al_copy_transform(&transform, al_get_current_transform());
+    if (!this->canvas) {
+      this->canvas = al_create_bitmap(width, height);
+      al_set_target_bitmap(this->canvas);
+      al_use_transform(&transform);
+      al_clear_to_color(al_map_rgb(0, 0, 0));
+      return false;
+    }
+    al_set_target_bitmap(this->canvas);
+    al_use_transform(&transform);
+    float x_1 = (float)left;
+    float y_1 = (float)top;
+    float x_2 = (float)right;
+    float y_2 = (float)bottom;
+    al_transform_coordinates(&transform, &x_1, &y_1); // Clipping is in pixels.
+    al_transform_coordinates(&transform, &x_2, &y_2);
+    int x = (int)std::max(std::floor(std::min(x_1, x_2)), 0.0f);
+    int y = (int)std::max(std::floor(std::min(y_1, y_2)), 0.0f);
+    int clip_width = (int)std::min(std::ceil(std::max(x_1, x_2)), (float)width) - x;
+    int clip_height = (int)std::min(std::ceil(std::max(y_1, y_2)), (float)height) - y;
+    al_set_clipping_rectangle(x, y, std::max(clip_width, 0), std::max(clip_height, 0));
+    return true;
+  }
+
+  /**
+   * Finishes a region and copies the whole retained frame to the screen.
+   */
+  void cBatched_Allegro_IO::End_Region() {
+    al_reset_clipping_rectangle();
+    al_set_target_bitmap(this->screen);
+    ALLEGRO_TRANSFORM transform;
+    ALLEGRO_TRANSFORM identity;
+    al_copy_transform(&transform, al_get_current_transform());
+    al_identity_transform(&identity);
+    al_use_transform(&identity);
+    al_draw_bitmap(this->canvas, 0, 0, 0);
+    al_use_transform(&transform);
+  }
+
+  /**
+   * Frees the decoded resources.
+   */
+  cBatched_Allegro_IO::~cBatched_Allegro_IO() {
+    this->stream.Stop(); // Decoded resources belong to the library tables.
+    this->Clear_Text_Cache();
+    if (this->canvas) {
+      al_destroy_bitmap(this->canvas);
+    }
+  }
+
+  /**
+   * Starts reading the listed resources in the background. Each one is
+   * decoded on the main thread the first time it is drawn or played, so
+   * the first frame does not wait on the whole list. Takes the place of
+   * loading the list up front.
+   * @param name The name of the resource list.
+   */
+  void cBatched_Allegro_IO::Stream_Resources(std::string name) {
+    this->stream.Start(name);
+  }
+
+  /**
+   * Gets how much of the streamed resources have been read.
+   * @return The percent loaded.
+   */
+  int cBatched_Allegro_IO::Get_Load_Progress() {
+    return this->stream.Get_Progress();
+  }
+
+  /**
+   * Draws an image through the library. A streamed image which is not read
+   * yet, or which is missing, is skipped so the frame does not wait on it.
+   * @param name The name of the image.
+   * @param x The x coordinate.
+   * @param y The y coordinate.
+   * @param width The width of the image.
+   * @param height The height of the image.
+   * @param angle The angle in degrees.
+   * @param flip_x Flips the image horizontally.
+   * @param flip_y Flips the image vertically.
+   */
+  void cBatched_Allegro_IO::Draw_Image(std::string name, int x, int y, int width, int height, int angle, bool flip_x, bool flip_y) {
+    int entry = this->stream.Find(name);
+    if ((entry == -1) || this->Decode_Image(entry)) {
+      cAllegro_IO::Draw_Image(name, x, y, width, height, angle, flip_x, flip_y);
+    }
+  }
+
+  /**
+   * Plays a sound through the library. A streamed sound which is not read
+   * yet, or which is missing, is skipped.
+   * @param name The name of the sound.
+   */
+  void cBatched_Allegro_IO::Play_Sound(std::string name) {
+    int entry = this->stream.Find(name);
+    if ((entry == -1) || this->Decode_Sound(entry)) {
+      cAllegro_IO::Play_Sound(name);
+    }
+  }
+
+  /**
+   * Decodes a streamed image the first time it is needed and adds it to the
+   * library images under its name, so it draws like a preloaded one.
+   * @param entry The entry of the image.
+   * @return True if the image is in the library, false if it is not read yet or failed.
+   */
+  bool cBatched_Allegro_IO::Decode_Image(int entry) {
+    if (this->stream.Get_State(entry) == eSTREAM_READ) {
+      ALLEGRO_FILE* file = this->Open_Entry(entry);
+      ALLEGRO_BITMAP* image = al_load_bitmap_f(file, al_identify_bitmap_f(file));
+      al_fclose(file);
+      if (image) {
+        this->images[this->stream.entries[entry].name] = image;
+      }
+      this->stream.Set_State(entry, image ? eSTREAM_DECODED : eSTREAM_FAILED);
+    }
+    return (this->stream.Get_State(entry) == eSTREAM_DECODED);
+  }
+
+  /**
+   * Decodes a streamed sound the first time it is needed and adds it to the
+   * library sounds under its name, so it plays like a preloaded one.
+   * @param entry The entry of the sound.
+   * @return True if the sound is in the library, false if it is not read yet or failed.
+   */
+  bool cBatched_Allegro_IO::Decode_Sound(int entry) {
+    if (this->stream.Get_State(entry) == eSTREAM_READ) {
+      ALLEGRO_FILE* file = this->Open_Entry(entry);
+      ALLEGRO_SAMPLE* sound = al_load_sample_f(file, al_identify_sample_f(file));
+      al_fclose(file);
+      if (sound) {
+        this->sounds[this->stream.entries[entry].name] = sound;
+      }
+      this->stream.Set_State(entry, sound ? eSTREAM_DECODED : eSTREAM_FAILED);
+    }
+    return (this->stream.Get_State(entry) == eSTREAM_DECODED);
+  }
+
+  /**
+   * Draws text from pre-rendered bitmaps. Numbers are composed from a
+   * digit atlas of their color and other text is rendered once per
+   * color and string, both in the font of the library. The least recently
+   * used bitmap makes room once a cache is full. Falls back to the library
+   * text output if there is no font.
+   * @param text The text to draw.
+   * @param x The x coordinate.
+   * @param y The y coordinate.
+   * @param red The red component.
+   * @param green The green component.
+   * @param blue The blue component.
+   */
+  void cBatched_Allegro_IO::Output_Text(std::string text, int x, int y, int red, int green, int blue) {
+    static const char* glyphs = "0123456789-";
+    if (!this->font) {
+      cAllegro_IO::Output_Text(text, x, y, red, green, blue);
+      return;
+    }
+    this->text_clock++;
+    std::string color = Number_To_Text(red) + " " + Number_To_Text(green) + " " + Number_To_Text(blue);
+    bool number = !text.empty() && (text.find_first_not_of(glyphs) == std::string::npos);
+    if (number) {
+      int atlas_index = this->Find_Atlas(color);
+      if (atlas_index != -1) {
+        this->text_stats.digit_hits++;
+      }
+      else {
+        sDigit_Atlas atlas;
+        atlas.key = color;
+        atlas.bitmap = this->Render_Text(glyphs, red, green, blue);
+        atlas.offsets[0] = 0;
+        for (int glyph_index = 0; glyph_index < eATLAS_GLYPHS; glyph_index++) {
+          atlas.offsets[glyph_index + 1] = al_get_text_width(this->font, std::string(glyphs, glyph_index + 1).c_str());
+        }
+        if (this->atlases.size() < eATLAS_LIMIT) {
+          atlas_index = this->atlases.size();
+          this->atlases.push_back(atlas);
+        }
+        else {
+          atlas_index = 0;
+          for (int slot = 1; slot < eATLAS_LIMIT; slot++) {
+            if (this->atlases[slot].last_use < this->atlases[atlas_index].last_use) {
+              atlas_index = slot;
+            }
+          }
+          if (this->atlases[atlas_index].bitmap) {
+            al_destroy_bitmap(this->atlases[atlas_index].bitmap);
+          }
+          this->atlases[atlas_index] = atlas;
+          this->atlas_evictions++;
+        }
+        if (this->atlas_evictions >= eATLAS_LIMIT) { // Drop the keys of evicted atlases.
+          this->atlas_ids = cHash<std::string, int>();
+          for (int slot = 0; slot < eATLAS_LIMIT; slot++) {
+            this->atlas_ids[this->atlases[slot].key] = slot;
+          }
+          this->atlas_evictions = 0;
+        }
+        this->atlas_ids[color] = atlas_index;
+        this->text_stats.digit_misses++;
+      }
+      sDigit_Atlas& atlas = this->atlases[atlas_index];
+      atlas.last_use = this->text_clock;
+      if (!atlas.bitmap) {
+        return;
+      }
+      int height = al_get_bitmap_height(atlas.bitmap);
+      int left = x;
+      int char_count = text.length();
+      al_hold_bitmap_drawing(true);
+      for (int char_index = 0; char_index < char_count; char_index++) {
+        int glyph = std::strchr(glyphs, text[char_index]) - glyphs;
+        int width = atlas.offsets[glyph + 1] - atlas.offsets[glyph];
+        al_draw_bitmap_region(atlas.bitmap, atlas.offsets[glyph], 0, width, height, left, y, 0);
+        left += width;
+      }
+      al_hold_bitmap_drawing(false);
+    }
+    else {
+      std::string key = color + " " + text;
+      int run_index = this->Find_Run(key);
+      if (run_index != -1) {
+        this->text_stats.run_hits++;
+      }
+      else {
+        sText_Run run;
+        run.key = key;
+        run.bitmap = this->Render_Text(text, red, green, blue);
+        if (this->runs.size() < eTEXT_CACHE_LIMIT) {
+          run_index = this->runs.size();
+          this->runs.push_back(run);
+        }
+        else {
+          run_index = 0;
+          for (int slot = 1; slot < eTEXT_CACHE_LIMIT; slot++) {
+            if (this->runs[slot].last_use < this->runs[run_index].last_use) {
+              run_index = slot;
+            }
+          }
+          if (this->runs[run_index].bitmap) {
+            al_destroy_bitmap(this->runs[run_index].bitmap);
+          }
+          this->runs[run_index] = run;
+          this->run_evictions++;
+        }
+        if (this->run_evictions >= eTEXT_CACHE_LIMIT) { // Drop the keys of evicted runs.
+          this->run_ids = cHash<std::string, int>();
+          for (int slot = 0; slot < eTEXT_CACHE_LIMIT; slot++) {
+            this->run_ids[this->runs[slot].key] = slot;
+          }
+          this->run_evictions = 0;
+        }
+        this->run_ids[key] = run_index;
+        this->text_stats.run_misses++;
+      }
+      this->runs[run_index].last_use = this->text_clock;
+      if (this->runs[run_index].bitmap) {
+        al_draw_bitmap(this->runs[run_index].bitmap, x, y, 0);
+      }
+    }
+  }
+
+  /**
+   * Renders text into a bitmap of its own.
+   * @param text The text to render.
+   * @param red The red component.
+   * @param green The green component.
+   * @param blue The blue component.
+   * @return The bitmap or NULL if the text is empty or could not be rendered.
+   */
+  ALLEGRO_BITMAP* cBatched_Allegro_IO::Render_Text(std::string text, int red, int green, int blue) {
+    int width = al_get_text_width(this->font, text.c_str());
+    ALLEGRO_BITMAP* bitmap = (width > 0) ? al_create_bitmap(width, al_get_font_line_height(this->font)) : NULL;
+    if (bitmap) {
+      ALLEGRO_BITMAP* target = al_get_target_bitmap();
+      al_set_target_bitmap(bitmap);
+      al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+      al_draw_text(this->font, al_map_rgb(red, green, blue), 0, 0, 0, text.c_str());
+      al_set_target_bitmap(target);
+    }
+    return bitmap;
+  }
+
+  /**
+   * Finds a pre-rendered text run. A key whose slot was given to other
+   * text is not found.
+   * @param key The color and text.
+   * @return The index of the run or -1 if it is not cached.
+   */
+  int cBatched_Allegro_IO::Find_Run(std::string key) {
+    int run_index = -1;
+    if (this->run_ids.Does_Key_Exist(key)) {
+      int slot = this->run_ids[key];
+      if ((slot >= 0) && (slot < (int)this->runs.size()) && (this->runs[slot].key == key)) {
+        run_index = slot;
+      }
+    }
+    return run_index;
+  }
+
+  /**
+   * Finds the digit atlas of a color. A key whose slot was given to another
+   * color is not found.
+   * @param key The color.
+   * @return The index of the atlas or -1 if it is not cached.
+   */
+  int cBatched_Allegro_IO::Find_Atlas(std::string key) {
+    int atlas_index = -1;
+    if (this->atlas_ids.Does_Key_Exist(key)) {
+      int slot = this->atlas_ids[key];
+      if ((slot >= 0) && (slot < (int)this->atlases.size()) && (this->atlases[slot].key == key)) {
+        atlas_index = slot;
+      }
+    }
+    return atlas_index;
+  }
+
+  /**
+   * Frees all of the pre-rendered text.
+   */
+  void cBatched_Allegro_IO::Clear_Text_Cache() {
+    int run_count = this->runs.size();
+    for (int run_index = 0; run_index < run_count; run_index++) {
+      if (this->runs[run_index].bitmap) {
+        al_destroy_bitmap(this->runs[run_index].bitmap);
+      }
+    }
+    int atlas_count = this->atlases.size();
+    for (int atlas_index = 0; atlas_index < atlas_count; atlas_index++) {
+      if (this->atlases[atlas_index].bitmap) {
+        al_destroy_bitmap(this->atlases[atlas_index].bitmap);
+      }
+    }
+    this->runs.clear();
+    this->atlases.clear();
+    this->run_ids = cHash<std::string, int>();
+    this->atlas_ids = cHash<std::string, int>();
+    this->run_evictions = 0;
+    this->atlas_evictions = 0;
+  }
+
+  /**
+   * Opens the bytes of a streamed resource as a file.
+   * @param entry The entry of the resource.
+   * @return The file.
+   */
+  ALLEGRO_FILE* cBatched_Allegro_IO::Open_Entry(int entry) {
+    std::string& bytes = this->stream.entries[entry].bytes;
+    return al_open_memfile(&bytes[0], bytes.length(), "r");
+  }
+
+  // **************************************************************************
+  // Spatial Grid Implementation
+  // **************************************************************************
+
+  /**
+   * Creates an empty spatial grid.
+   */
+  cSpatial_Grid::cSpatial_Grid() {
+    this->cell_size = 1;
+  }
+
+  /**
+   * Empties the grid and sizes it for a number of objects. The storage is
+   * kept from one use to the next.
+   * @param cell_size The width and height of a cell.
+   * @param object_count The number of objects which will be filed.
+   */
+  void cSpatial_Grid::Reset(int cell_size, int object_count) {
+    int bucket_count = 16;
+    while (bucket_count < (object_count * 2)) {
+      bucket_count *= 2; // Stays a power of two for masking.
+    }
+    this->cell_size = cell_size;
+    this->heads.assign(bucket_count, -1);
+    this->entries.clear();
+  }
+
+  /**
+   * Files an object in every cell its box touches.
+   * @param object The record index of the object.
+   * @param left The left edge.
+   * @param top The top edge.
+   * @param right The right edge, past the box.
+   * @param bottom The bottom edge, past the box.
+   */
+  void cSpatial_Grid::Insert(int object, long long left, long long top, long long right, long long bottom) {
+    int last_x = this->Get_Cell(right - 1);
+    int last_y = this->Get_Cell(bottom - 1);
+    for (int cell_y = this->Get_Cell(top); cell_y <= last_y; cell_y++) {
+      for (int cell_x = this->Get_Cell(left); cell_x <= last_x; cell_x++) {
+        int bucket = this->Find_Bucket(cell_x, cell_y);
+        sGrid_Entry entry;
+        entry.object = object;
+        entry.cell_x = cell_x;
+        entry.cell_y = cell_y;
+        entry.next = this->heads[bucket];
+        this->heads[bucket] = this->entries.size();
+        this->entries.push_back(entry);
+      }
+    }
+  }
+
+  /**
+   * Gets the cell a coordinate falls in, rounding down for negatives.
+   * Cells past the grid edge are folded into the edge so that a loop over
+   * cells cannot overflow.
+   * @param coordinate The coordinate.
+   * @return The cell.
+   */
+  int cSpatial_Grid::Get_Cell(long long coordinate) {
+    long long cell = (coordinate >= 0) ? (coordinate / this->cell_size) : (-((-coordinate - 1) / this->cell_size) - 1);
+    return (int)std::min(std::max(cell, (long long)-eGRID_EDGE), (long long)eGRID_EDGE);
+  }
+
+  /**
+   * Hashes a cell to its bucket.
+   * @param cell_x The cell column.
+   * @param cell_y The cell row.
+   * @return The bucket.
+   */
+  int cSpatial_Grid::Find_Bucket(int cell_x, int cell_y) {
+    unsigned int hash = ((unsigned int)cell_x * 73856093u) ^ ((unsigned int)cell_y * 19349663u);
+    return hash & (this->heads.size() - 1);
+  }
+
+  // **************************************************************************
+  // Resource Stream Implementation
+  // **************************************************************************
+
+  /**
+   * Creates an empty resource stream.
+   */
+  cResource_Stream::cResource_Stream() {
+    this->finished = 0;
+    this->stopping = false;
+  }
+
+  /**
+   * Waits for the reader to stop.
+   */
+  cResource_Stream::~cResource_Stream() {
+    this->Stop();
+  }
+
+  /**
+   * Reads a resource list and starts reading the resources in the
+   * background. Each line of the list is the path of a file, which is
+   * named by the file name without its folder or extension.
+   * @param name The name of the resource list.
+   */
+  void cResource_Stream::Start(std::string name) {
+    std::string text;
+    if (!Read_Text_File(name + ".txt", text)) {
+      return; // Nothing to stream.
+    }
+    std::istringstream lines(text);
+    std::string path;
+    while (std::getline(lines, path)) {
+      if (!path.empty() && (path[path.length() - 1] == '\r')) {
+        path.erase(path.length() - 1);
+      }
+      if (path.empty()) {
+        continue;
+      }
+      std::string::size_type start = path.find_last_of("/\\");
+      start = (start == std::string::npos) ? 0 : start + 1;
+      sStream_Entry entry;
+      entry.name = path.substr(start, path.find_last_of('.') - start);
+      entry.path = path;
+      entry.state = eSTREAM_QUEUED;
+      this->names[entry.name] = this->entries.size();
+      this->entries.push_back(entry);
+    }
+    this->reader = std::thread(&cResource_Stream::Read_Entries, this);
+  }
+
+  /**
+   * Stops reading resources.
+   */
+  void cResource_Stream::Stop() {
+    this->stopping = true;
+    if (this->reader.joinable()) {
+      this->reader.join();
+    }
+  }
+
+  /**
+   * Finds a streamed resource.
+   * @param name The name of the resource.
+   * @return The entry of the resource or -1 if it is not streamed.
+   */
+  int cResource_Stream::Find(std::string name) {
+    if (!this->names.Does_Key_Exist(name)) {
+      return -1;
+    }
+    return this->names[name];
+  }
+
+  /**
+   * Gets the state of a streamed resource.
+   * @param entry The entry of the resource.
+   * @return The state.
+   */
+  int cResource_Stream::Get_State(int entry) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->entries[entry].state;
+  }
+
+  /**
+   * Sets the state of a streamed resource. Decoded and failed resources
+   * drop their bytes.
+   * @param entry The entry of the resource.
+   * @param state The state.
+   */
+  void cResource_Stream::Set_State(int entry, int state) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->entries[entry].state = state;
+    if (state != eSTREAM_READ) {
+      std::string().swap(this->entries[entry].bytes);
+    }
+  }
+
+  /**
+   * Gets how many of the resources have been read.
+   * @return The percent read.
+   */
+  int cResource_Stream::Get_Progress() {
+    int count = this->entries.size();
+    return count ? (this->finished * 100) / count : 100;
+  }
+
+  /**
+   * Reads the bytes of every resource. Runs on the reader thread.
+   */
+  void cResource_Stream::Read_Entries() {
+    int count = this->entries.size();
+    for (int entry_index = 0; (entry_index < count) && !this->stopping; entry_index++) {
+      std::string bytes;
+      bool read = Read_Text_File(this->entries[entry_index].path, bytes);
+      {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->entries[entry_index].bytes.swap(bytes);
+        this->entries[entry_index].state = read ? eSTREAM_READ : eSTREAM_FAILED;
+      }
+      this->finished++;
+    }
+  }
+
+  // **************************************************************************
+  // I/O Queue Implementation
+  // **************************************************************************
+
+  /**
+   * Creates a queue which holds the output of one pooled script until the
+   * main thread replays it.
+   * @param io The I/O control of the main thread.
+   * @param io_lock The lock around direct use of the I/O control.
+   * @param seed The seed for random numbers, so each script is repeatable.
+   */
+  cIO_Queue::cIO_Queue(cIO_Control* io, std::mutex* io_lock, unsigned int seed) {
+    this->io = io;
+    this->io_lock = io_lock;
+    this->seed = seed;
+    this->signal = 0;
+    this->refresh = false;
+  }
+
+  /**
+   * Queues a command.
+   * @param type The type of command.
+   * @param text The text or name the command uses.
+   * @param values The numbers the command uses.
+   * @param count The number of values.
+   */
+  void cIO_Queue::Queue(int type, std::string text, const int* values, int count) {
+    sIO_Command command;
+    command.type = type;
+    command.text = text;
+    for (int value_index = 0; value_index < count; value_index++) {
+      command.values[value_index] = values[value_index];
+    }
+    this->commands.push_back(command);
+  }
+
+  /**
+   * Sends the queued commands to the I/O control in the order they were
+   * made. Must be called from the main thread.
+   * @return True if the script asked for a refresh.
+   */
+  bool cIO_Queue::Replay() {
+    int command_count = (int)this->commands.size();
+    for (int command_index = 0; command_index < command_count; command_index++) {
+      sIO_Command& command = this->commands[command_index];
+      int* values = command.values;
+      switch (command.type) {
+        case eIO_TEXT:
+          this->io->Output_Text(command.text, values[0], values[1], values[2], values[3], values[4]);
+          break;
+        case eIO_DRAW:
+          this->io->Draw_Image(command.text, values[0], values[1], values[2], values[3], values[4], (bool)values[5], (bool)values[6]);
+          break;
+        case eIO_SOUND:
+          this->io->Play_Sound(command.text);
+          break;
+        case eIO_MUSIC:
+          this->io->Play_Music(command.text);
+          break;
+        case eIO_SILENCE:
+          this->io->Silence();
+          break;
+        case eIO_COLOR:
+          this->io->Color(values[0], values[1], values[2]);
+          break;
+      }
+    }
+    this->commands.clear();
+    bool refresh = this->refresh;
+    this->refresh = false;
+    return refresh;
+  }
+
+  /**
+   * Gets a repeatable random number.
+   * @param low The lowest number.
+   * @param high The highest number.
+   * @return The random number.
+   */
+  int cIO_Queue::Get_Random_Number(int low, int high) {
+    return Next_Random(this->seed, low, high);
+  }
+
+  /**
+   * Queues text output.
+   * @param text The text.
+   * @param x The x coordinate.
+   * @param y The y coordinate.
+   * @param red The red component.
+   * @param green The green component.
+   * @param blue The blue component.
+   */
+  void cIO_Queue::Output_Text(std::string text, int x, int y, int red, int green, int blue) {
+    int values[] = { x, y, red, green, blue };
+    this->Queue(eIO_TEXT, text, values, 5);
+  }
+
+  /**
+   * Loads a matrix right away since the script needs it at once. The main
+   * thread waits for the pool while scripts run so the lock only keeps
+   * scripts apart.
+   * @param name The name of the matrix file.
+   * @param matrix The matrix.
+   */
+  void cIO_Queue::Load(std::string name, cMatrix& matrix) {
+    std::lock_guard<std::mutex> lock(*this->io_lock);
+    this->io->Load(name, matrix);
+  }
+
+  /**
+   * Saves a matrix right away.
+   * @param name The name of the matrix file.
+   * @param matrix The matrix.
+   */
+  void cIO_Queue::Save(std::string name, cMatrix& matrix) {
+    std::lock_guard<std::mutex> lock(*this->io_lock);
+    this->io->Save(name, matrix);
+  }
+
+  /**
+   * Queues an image draw.
+   * @param name The name of the image.
+   * @param x The x coordinate.
+   * @param y The y coordinate.
+   * @param width The width.
+   * @param height The height.
+   * @param angle The angle.
+   * @param flip_x Whether the image is flipped horizontally.
+   * @param flip_y Whether the image is flipped vertically.
+   */
+  void cIO_Queue::Draw_Image(std::string name, int x, int y, int width, int height, int angle, bool flip_x, bool flip_y) {
+    int values[] = { x, y, width, height, angle, flip_x, flip_y };
+    this->Queue(eIO_DRAW, name, values, 7);
+  }
+
+  /**
+   * Queues a sound.
+   * @param name The name of the sound.
+   */
+  void cIO_Queue::Play_Sound(std::string name) {
+    this->Queue(eIO_SOUND, name, NULL, 0);
+  }
+
+  /**
+   * Queues music.
+   * @param name The name of the music.
+   */
+  void cIO_Queue::Play_Music(std::string name) {
+    this->Queue(eIO_MUSIC, name, NULL, 0);
+  }
+
+  /**
+   * Queues silence.
+   */
+  void cIO_Queue::Silence() {
+    this->Queue(eIO_SILENCE, "", NULL, 0);
+  }
+
+  /**
+   * Notes a refresh. The pool refreshes once per frame for all scripts.
+   */
+  void cIO_Queue::Refresh() {
+    this->refresh = true;
+  }
+
+  /**
+   * Queues a color change.
+   * @param red The red component.
+   * @param green The green component.
+   * @param blue The blue component.
+   */
+  void cIO_Queue::Color(int red, int green, int blue) {
+    int values[] = { red, green, blue };
+    this->Queue(eIO_COLOR, "", values, 3);
+  }
+
+  /**
+   * Reads the signal the main thread read for this frame.
+   * @return The signal.
+   */
+  sSignal cIO_Queue::Read_Signal() {
+    sSignal signal;
+    signal.code = this->signal;
+    return signal;
+  }
+
+  /**
+   * Gets how much of the streamed resources have been loaded. Only reads the
+   * progress so it does not need the I/O lock.
+   * @return The percent loaded.
+   */
+  int cIO_Queue::Get_Load_Progress() {
+    cResource_Control* resource_io = dynamic_cast<cResource_Control*>(this->io);
+    return resource_io ? resource_io->Get_Load_Progress() : 100;
+  }
+
+  // **************************************************************************
+  // Source Pool Implementation
+  // **************************************************************************
+
+  /**
+   * Creates a pool of worker threads for running many scripts.
+   * @param io The I/O control of the main thread.
+   * @param thread_count The number of threads including the main thread.
+   * @param steps The number of statements each script runs per frame.
+   */
+  cSource_Pool::cSource_Pool(cIO_Control* io, int thread_count, int steps) :
+    work_locks(std::max(thread_count, 1)) {
+    this->io = io;
+    this->steps = steps;
+    this->frame = 0;
+    this->busy = 0;
+    this->stopping = false;
+    this->work.resize(this->work_locks.size());
+    for (int worker = 1; worker < (int)this->work.size(); worker++) { // The main thread is worker 0.
+      this->threads.push_back(std::thread(&cSource_Pool::Work, this, worker));
+    }
+  }
+
+  /**
+   * Stops the workers and frees the scripts.
+   */
+  cSource_Pool::~cSource_Pool() {
+    {
+      std::lock_guard<std::mutex> lock(this->frame_lock);
+      this->stopping = true;
+    }
+    this->frame_start.notify_all();
+    for (int thread_index = 0; thread_index < (int)this->threads.size(); thread_index++) {
+      this->threads[thread_index].join();
+    }
+    for (int source_index = 0; source_index < (int)this->sources.size(); source_index++) {
+      delete this->sources[source_index];
+      delete this->queues[source_index];
+    }
+  }
+
+  /**
+   * Adds a script to the pool. A var named instance is set to the index of
+   * the script so copies of one program can tell themselves apart.
+   * @param program The name of the program.
+   * @param options The compile options.
+   * @return The index of the script.
+   * @throws An error if the program does not compile.
+   */
+  int cSource_Pool::Add(std::string program, int options) {
+    int index = (int)this->sources.size();
+    cIO_Queue* queue = new cIO_Queue(this->io, &this->io_lock, (unsigned int)index + 1);
+    cSource* source = NULL;
+    try {
+      source = new cSource(program, queue, options);
+    }
+    catch (cError error) {
+      delete queue;
+      throw;
+    }
+    source->Preset_Var("instance", index);
+    source->file_suffix = "." + Number_To_Text(index);
+    this->sources.push_back(source);
+    this->queues.push_back(queue);
+    return index;
+  }
+
+  /**
+   * Runs every script for one frame across the workers, then replays their
+   * output on this thread in script order.
+   */
+  void cSource_Pool::Run_Frame() {
+    int signal = this->io->Read_Signal().code;
+    int worker_count = (int)this->work.size();
+    int source_count = (int)this->sources.size();
+    for (int source_index = 0; source_index < source_count; source_index++) {
+      this->queues[source_index]->signal = signal;
+      if (this->sources[source_index]->status != eSTATUS_DONE) {
+        this->work[source_index % worker_count].push_back(source_index);
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(this->frame_lock);
+      this->frame++;
+      this->busy = worker_count;
+    }
+    this->frame_start.notify_all();
+    this->Run_Work(0);
+    {
+      std::unique_lock<std::mutex> lock(this->frame_lock);
+      this->busy--;
+      while (this->busy > 0) {
+        this->frame_done.wait(lock);
+      }
+    }
+    std::sort(this->errors.begin(), this->errors.end(), [](const std::pair<int, cError>& a, const std::pair<int, cError>& b) {
+      return a.first < b.first;
+    });
+    bool refresh = false;
+    for (int source_index = 0; source_index < source_count; source_index++) {
+      refresh = this->queues[source_index]->Replay() || refresh;
+    }
+    for (int error_index = 0; error_index < (int)this->errors.size(); error_index++) {
+      this->errors[error_index].second.Print();
+    }
+    this->errors.clear();
+    if (refresh) {
+      this->io->Refresh();
+    }
+  }
+
+  /**
+   * Waits for frames and runs work until the pool stops.
+   * @param worker The index of the worker.
+   */
+  void cSource_Pool::Work(int worker) {
+    int frame = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(this->frame_lock);
+        while ((this->frame == frame) && !this->stopping) {
+          this->frame_start.wait(lock);
+        }
+        if (this->stopping) {
+          return;
+        }
+        frame = this->frame;
+      }
+      this->Run_Work(worker);
+      {
+        std::lock_guard<std::mutex> lock(this->frame_lock);
+        this->busy--;
+      }
+      this->frame_done.notify_all();
+    }
+  }
+
+  /**
+   * Runs scripts until no worker has any left.
+   * @param worker The index of the worker.
+   */
+  void cSource_Pool::Run_Work(int worker) {
+    int index = this->Take_Work(worker);
+    while (index != -1) {
+      try {
+        this->sources[index]->Run_Steps(this->steps);
+      }
+      catch (cError error) {
+        this->sources[index]->status = eSTATUS_DONE;
+        std::lock_guard<std::mutex> lock(this->frame_lock);
+        this->errors.push_back(std::pair<int, cError>(index, error));
+      }
+      index = this->Take_Work(worker);
+    }
+  }
+
+  /**
+   * Takes a script from the front of this worker's queue, or steals one
+   * from the back of another worker's queue.
+   * @param worker The index of the worker.
+   * @return The index of the script or -1 if there is no work left.
+   */
+  int cSource_Pool::Take_Work(int worker) {
+    int worker_count = (int)this->work.size();
+    for (int offset = 0; offset < worker_count; offset++) {
+      int victim = (worker + offset) % worker_count;
+      std::lock_guard<std::mutex> lock(this->work_locks[victim]);
+      std::deque<int>& queue = this->work[victim];
+      if (!queue.empty()) {
+        int index = 0;
+        if (offset == 0) {
+          index = queue.front();
+          queue.pop_front();
+        }
+        else {
+          index = queue.back();
+          queue.pop_back();
+        }
+        return index;
+      }
+    }
+    return -1;
+  }
+
+  /**
+   * Checks whether every script has stopped.
+   * @return True if all scripts are done.
+   */
+  bool cSource_Pool::Is_Done() {
+    for (int source_index = 0; source_index < (int)this->sources.size(); source_index++) {
+      if (this->sources[source_index]->status != eSTATUS_DONE) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // **************************************************************************
+  // Headless I/O Implementation
+  // **************************************************************************
+
+  /**
+   * Creates an I/O control which records calls instead of rendering them.
+   * @param record True if each call should be kept as text, false to only count them.
+   */
+  cHeadless_IO::cHeadless_IO(bool record) {
+    this->record = record;
+    this->signal_index = 0;
+    this->seed = 1;
+    this->draw_count = 0;
+    this->text_count = 0;
+    this->sound_count = 0;
+    this->refresh_count = 0;
+  }
+
+  /**
+   * Loads the signal codes returned by Read_Signal, one per line.
+   * @param name The name of the signal file.
+   * @throws An error if the file could not be read.
+   */
+  void cHeadless_IO::Load_Signals(std::string name) {
+    cFile signal_file(name);
+    signal_file.Read();
+    while (!signal_file.Has_More_Lines()) {
+      std::string line = signal_file.Get_Line();
+      if (line.length() > 0) {
+        this->signals.push_back(Text_To_Number(line));
+      }
+    }
+  }
+
+  /**
+   * Checks whether any scripted signals are left.
+   * @return True if Read_Signal has more codes to return.
+   */
+  bool cHeadless_IO::Has_Signals() {
+    return this->signal_index < (int)this->signals.size();
+  }
+
+  /**
+   * Keeps a call if recording.
+   * @param call The call as text.
+   */
+  void cHeadless_IO::Record(std::string call) {
+    if (this->record) {
+      this->calls.Add(call);
+    }
+  }
+
+  /**
+   * Gets a repeatable random number.
+   * @param low The lowest number.
+   * @param high The highest number.
+   * @return The random number.
+   */
+  int cHeadless_IO::Get_Random_Number(int low, int high) {
+    return Next_Random(this->seed, low, high);
+  }
+
+  /**
+   * Records text output.
+   * @param text The text.
+   * @param x The x coordinate.
+   * @param y The y coordinate.
+   * @param red The red component.
+   * @param green The green component.
+   * @param blue The blue component.
+   */
+  void cHeadless_IO::Output_Text(std::string text, int x, int y, int red, int green, int blue) {
+    this->text_count++;
+    this->Record("text " + text + " " + Number_To_Text(x) + " " + Number_To_Text(y) + " " + Number_To_Text(red) + " " + Number_To_Text(green) + " " + Number_To_Text(blue));
+  }
+
+  /**
+   * Records a matrix load. The matrix is left as it is.
+   * @param name The name of the matrix file.
+   * @param matrix The matrix.
+   */
+  void cHeadless_IO::Load(std::string name, cMatrix& /* matrix */) {
+    this->Record("load " + name);
+  }
+
+  /**
+   * Records a matrix save. Nothing is written.
+   * @param name The name of the matrix file.
+   * @param matrix The matrix.
+   */
+  void cHeadless_IO::Save(std::string name, cMatrix& /* matrix */) {
+    this->Record("save " + name);
+  }
+
+  /**
+   * Records an image draw.
+   * @param name The name of the image.
+   * @param x The x coordinate.
+   * @param y The y coordinate.
+   * @param width The width.
+   * @param height The height.
+   * @param angle The angle.
+   * @param flip_x Whether the image is flipped horizontally.
+   * @param flip_y Whether the image is flipped vertically.
+   */
+  void cHeadless_IO::Draw_Image(std::string name, int x, int y, int width, int height, int angle, bool flip_x, bool flip_y) {
+    this->draw_count++;
+    this->Record("draw " + name + " " + Number_To_Text(x) + " " + Number_To_Text(y) + " " + Number_To_Text(width) + " " + Number_To_Text(height) + " " + Number_To_Text(angle) + " " + Number_To_Text(flip_x) + " " + Number_To_Text(flip_y));
+  }
+
+  /**
+   * Records a sound.
+   * @param name The name of the sound.
+   */
+  void cHeadless_IO::Play_Sound(std::string name) {
+    this->sound_count++;
+    this->Record("sound " + name);
+  }
+
+  /**
+   * Records music.
+   * @param name The name of the music.
+   */
+  void cHeadless_IO::Play_Music(std::string name) {
+    this->sound_count++;
+    this->Record("music " + name);
+  }
+
+  /**
+   * Records silence.
+   */
+  void cHeadless_IO::Silence() {
+    this->Record("silence");
+  }
+
+  /**
+   * Records a refresh.
+   */
+  void cHeadless_IO::Refresh() {
+    this->refresh_count++;
+    this->Record("refresh");
+  }
+
+  /**
+   * Records a color change.
+   * @param red The red component.
+   * @param green The green component.
+   * @param blue The blue component.
+   */
+  void cHeadless_IO::Color(int red, int green, int blue) {
+    this->Record("color " + Number_To_Text(red) + " " + Number_To_Text(green) + " " + Number_To_Text(blue));
+  }
+
+  /**
+   * Records the start of a redrawn region.
+   * @param left The left edge.
+   * @param top The top edge.
+   * @param right The right edge.
+   * @param bottom The bottom edge.
+   * @return Always true since nothing is drawn.
+   */
+  bool cHeadless_IO::Begin_Region(int left, int top, int right, int bottom) {
+    this->Record("region " + Number_To_Text(left) + " " + Number_To_Text(top) + " " + Number_To_Text(right) + " " + Number_To_Text(bottom));
+    return true;
+  }
+
+  /**
+   * Records the end of a redrawn region.
+   */
+  void cHeadless_IO::End_Region() {
+    this->Record("end region");
+  }
+
+  /**
+   * Reads the next scripted signal.
+   * @return The signal. Its code is zero once the script has run out.
+   */
+  sSignal cHeadless_IO::Read_Signal() {
+    sSignal signal;
+    signal.code = 0;
+    if (this->signal_index < (int)this->signals.size()) {
+      signal.code = this->signals[this->signal_index++];
+    }
+    return signal;
+  }
+
+  // **************************************************************************
+  // Profiler Implementation
+  // **************************************************************************
+
+  /**
+   * Creates a profiler for a source module.
+   * @param source The source module.
+   * @param name The name of the program, used as the root of every stack.
+   */
+  cProfiler::cProfiler(cSource* source, std::string name) {
+    this->source = source;
+    this->line_ids.resize(source->code.size(), -1);
+    this->command_ids.resize(source->code.size(), -1);
+    this->frames.push_back(name);
+    this->frame_depths.push_back(0);
+    this->stack_id = this->stacks.Get_Id(name);
+    this->last_time = std::chrono::steady_clock::now();
+  }
+
+  /**
+   * Starts timing again at the start of a slice, so time spent outside the
+   * interpreter is not charged to the next statement.
    */
-  void cSource::Generate_Parse_Error(std::string message, sToken token) {
-    throw cError("Error: " + message + "\nLine No: " + Number_To_Text(token.line_no) + "\nSource: " + token.source + "\nToken: " + token.token);
+  void cProfiler::Resume() {
+    this->last_time = std::chrono::steady_clock::now();
   }
 
   /**
-   * Runs the program.
+   * Runs one statement and charges its time to its line, its command, the
+   * subroutines it is running in and the current stack.
    * @throws An error if there is an illegal command.
    */
-  void cSource::Run(int timeout) {
-    auto start = std::chrono::system_clock::now();
-    while (this->status != eSTATUS_DONE) {
-      auto end = std::chrono::system_clock::now();
-      auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-      if (diff.count() < timeout) {
-        this->Interpret();
+  void cProfiler::Step() {
+    int position = this->source->pointer;
+    int opcode = this->source->code[position];
+    this->source->Interpret();
+    auto now = std::chrono::steady_clock::now();
+    long long nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(now - this->last_time).count();
+    this->last_time = now;
+    if (this->line_ids[position] == -1) {
+      int statement = this->source->statement_tokens[position];
+      sScript_Token& token = this->source->tokens[this->source->code_tokens[position]];
+      this->line_ids[position] = this->lines.Get_Id(this->source->texts[token.source] + ":" + Number_To_Text(token.line_no));
+      this->command_ids[position] = this->commands.Get_Id((statement != -1) ? this->source->Get_Text(this->source->tokens[statement]) : opcode_infos[opcode].name);
+    }
+    this->lines.Charge(this->line_ids[position], nanos);
+    this->commands.Charge(this->command_ids[position], nanos);
+    this->stacks.Charge(this->stack_id, nanos);
+    int frame_count = (int)this->frames.size();
+    for (int frame_index = 1; frame_index < frame_count; frame_index++) {
+      if (this->Is_Outermost(frame_index)) { // Recursion is only charged once.
+        this->subroutines.entries[this->subroutine_ids[frame_index - 1]].nanos += nanos;
       }
-      else {
-        break;
+    }
+    if (opcode == eOPCODE_CALL) {
+      std::string name = this->source->Get_Text(this->source->tokens[this->source->code_tokens[position]]);
+      int id = this->subroutines.Get_Id(name);
+      this->subroutines.entries[id].count++;
+      this->subroutine_ids.push_back(id);
+      this->frames.push_back(name);
+      this->frame_depths.push_back(this->source->stack.Count());
+      this->Update_Stack();
+    }
+    else {
+      bool popped = false;
+      while ((this->frames.size() > 1) && (this->frame_depths.back() > this->source->stack.Count())) { // Returned.
+        this->frames.pop_back();
+        this->frame_depths.pop_back();
+        this->subroutine_ids.pop_back();
+        popped = true;
+      }
+      if (popped) {
+        this->Update_Stack();
       }
     }
   }
 
   /**
-   * Gets a token from the token stack but does not remove it.
-   * @return The token at the pointer.
-   * @throws An error if there are no more tokens.
+   * Checks that a frame is the outermost call of its subroutine.
+   * @param frame_index The index of the frame.
+   * @return True if no outer frame runs the same subroutine.
    */
-  sToken& cSource::Get_Token() {
-    if (this->pointer >= this->tokens.Count()) {
-      throw cError("No more tokens left!");
+  bool cProfiler::Is_Outermost(int frame_index) {
+    int id = this->subroutine_ids[frame_index - 1];
+    for (int outer_index = 1; outer_index < frame_index; outer_index++) {
+      if (this->subroutine_ids[outer_index - 1] == id) {
+        return false;
+      }
     }
-    return this->tokens[this->pointer++];
+    return true;
   }
 
   /**
-   * Evaluates an expression and returns the result.
-   * @return The value of the result.
+   * Finds the id of the current stack in collapsed form.
    */
-  int cSource::Eval_Expression() {
-    int result = this->Eval_Operand();
-    sToken oper = this->Peek_Token();
-    while (this->Is_Operator(oper)) {
-      oper = this->Get_Token();
-      int value = this->Eval_Operand();
-      if (oper.token == "+") {
-        result += value;
-      }
-      else if (oper.token == "-") {
-        result -= value;
-      }
-      else if (oper.token == "*") {
-        result *= value;
-      }
-      else if (oper.token == "/") {
-        result /= value;
-      }
-      else if (oper.token == "rem") {
-        result %= value;
-      }
-      else if (oper.token == "rand") {
-        result = this->io->Get_Random_Number(result, value);
-      }
-      else if (oper.token == "cos") {
-        result = (int)((double)result * std::cos((double)value * 3.14 / 180.0));
-      }
-      else if (oper.token == "sin") {
-        result = (int)((double)result * std::sin((double)value * 3.14 / 180.0));
-      }
-      oper = this->Peek_Token();
+  void cProfiler::Update_Stack() {
+    std::string stack = this->frames[0];
+    int frame_count = (int)this->frames.size();
+    for (int frame_index = 1; frame_index < frame_count; frame_index++) {
+      stack += ";" + this->frames[frame_index];
     }
-    return result;
+    this->stack_id = this->stacks.Get_Id(stack);
   }
 
   /**
-   * Pulls a token but does not increment the pointer.
-   * @return The token.
-   * @throws An error if there is no token.
+   * Writes the sorted report to <name>.profile.txt and the collapsed stacks
+   * for flame graphs to <name>.folded.
+   * @param name The name of the program.
+   * @throws An error if a file could not be written.
    */
-  sToken& cSource::Peek_Token() {
-    if (this->pointer >= this->tokens.Count()) {
-      throw cError("No more tokens left!");
+  void cProfiler::Write(std::string name) {
+    std::ofstream report((name + ".profile.txt").c_str());
+    if (!report) {
+      throw cError("Could not write profile for " + name + ".");
+    }
+    this->lines.Write(report, "Lines");
+    this->commands.Write(report, "Commands");
+    this->subroutines.Write(report, "Subroutines");
+    std::ofstream folded((name + ".folded").c_str());
+    if (!folded) {
+      throw cError("Could not write stacks for " + name + ".");
+    }
+    int stack_count = this->stacks.names.Count();
+    for (int stack_index = 0; stack_index < stack_count; stack_index++) {
+      folded << this->stacks.names[stack_index] << " " << (this->stacks.entries[stack_index].nanos / 1000) << "\n";
     }
-    return this->tokens[this->pointer];
   }
 
+  // **************************************************************************
+  // Profile Table Implementation
+  // **************************************************************************
+
   /**
-   * Checks to see if a keyword exists.
-   * @param keyword The keyword to check.
-   * @throws An error if the keyword does not exist.
+   * Gets the id of an entry, adding the entry if it is new.
+   * @param name The name of the entry.
+   * @return The id of the entry.
    */
-  void cSource::Check_Keyword(std::string keyword) {
-    sToken token = this->Get_Token();
-    if (token.token != keyword) {
-      this->Generate_Parse_Error("Keyword " + keyword + " missing.", token);
+  int cProfile_Table::Get_Id(std::string name) {
+    if (!this->ids.Does_Key_Exist(name)) {
+      sProfile_Entry entry;
+      entry.count = 0;
+      entry.nanos = 0;
+      this->ids[name] = this->names.Count();
+      this->names.Add(name);
+      this->entries.push_back(entry);
     }
+    return this->ids[name];
   }
 
   /**
-   * Determines if a token is conditional logic.
-   * @param token The token to check.
-   * @return True if the token is logic, false otherwise.
+   * Charges one run to an entry.
+   * @param id The id of the entry.
+   * @param nanos The time of the run in nanoseconds.
    */
-  bool cSource::Is_Logic(sToken& token) {
-    return ((token.token == "and") || (token.token == "or"));
+  void cProfile_Table::Charge(int id, long long nanos) {
+    this->entries[id].count++;
+    this->entries[id].nanos += nanos;
   }
 
   /**
-   * Evaluates a condition.
-   * @return True if the condition evaluated to true, false otherwise.
+   * Writes the entries sorted from the most to the least time.
+   * @param output The output stream.
+   * @param title The title of the section.
    */
-  bool cSource::Eval_Condition() {
-    bool result = false;
-    int left_result = this->Eval_Expression();
-    sToken test = this->Get_Token();
-    int right_result = this->Eval_Expression();
-    int diff = (left_result - right_result);
-    if (test.token == "=") {
-      result = (diff == 0);
+  void cProfile_Table::Write(std::ostream& output, std::string title) {
+    std::vector<int> order;
+    int entry_count = (int)this->entries.size();
+    for (int entry_index = 0; entry_index < entry_count; entry_index++) {
+      order.push_back(entry_index);
     }
-    else if (test.token == "not") {
-      result = (diff != 0);
+    std::vector<sProfile_Entry>& entries = this->entries;
+    std::stable_sort(order.begin(), order.end(), [&entries](int a, int b) {
+      return entries[a].nanos > entries[b].nanos;
+    });
+    output << title << "\n" << "time (us)\tcount\tname\n";
+    for (int entry_index = 0; entry_index < entry_count; entry_index++) {
+      sProfile_Entry& entry = this->entries[order[entry_index]];
+      output << (entry.nanos / 1000) << "\t" << entry.count << "\t" << this->names[order[entry_index]] << "\n";
     }
-    else if (test.token == ">") {
-      result = (diff > 0);
-    }
-    else if (test.token == "<") {
-      result = (diff < 0);
-    }
-    else if (test.token == ">or=") {
-      result = (diff >= 0);
-    }
-    else if (test.token == "<or=") {
-      result = (diff <= 0);
-    }
-    else {
-      this->Generate_Parse_Error("Invalid test " + test.token + ".", test);
-    }
-    return result;
+    output << "\n";
+  }
+
+  // **************************************************************************
+  // Flat Matrix Implementation
+  // **************************************************************************
+
+  /**
+   * Creates an empty matrix.
+   */
+  cFlat_Matrix::cFlat_Matrix() {
+    this->width = 0;
+    this->height = 0;
+    this->cells = NULL;
   }
 
   /**
-   * Evalulates a conditional.
-   * @return The result of the conditional.
+   * Creates a matrix of zeros stored row after row in one buffer.
+   * @param width The width of the matrix.
+   * @param height The height of the matrix.
    */
-  int cSource::Eval_Conditional() {
-    int result = this->Eval_Condition();
-    sToken logic = this->Peek_Token();
-    while (this->Is_Logic(logic)) {
-      logic = this->Get_Token();
-      bool test = this->Eval_Condition();
-      if (logic.token == "and") {
-        result *= test; // Multiply to AND.
-      }
-      else if (logic.token == "or") {
-        result += test; // Add to OR.
-      }
-      logic = this->Peek_Token();
-    }
-    return result;
+  cFlat_Matrix::cFlat_Matrix(int width, int height) {
+    this->width = std::max(width, 0);
+    this->height = std::max(height, 0);
+    this->data.assign(this->width * this->height, 0);
+    this->cells = this->data.data();
   }
 
   /**
-   * Evaluates the operand.
-   * @return The operand which is numeric.
-   * @throws An error if something went wrong.
+   * Copies a matrix. A copy of a mapped matrix gets its own buffer.
+   * @param other The matrix to copy.
    */
-  int cSource::Eval_Operand() {
-    int value = 0;
-    sToken token = this->Get_Token();
-    try {
-      value = Text_To_Number(token.token);
-    }
-    catch (cError error) { // Probably a placeholder.
-      if (token.token.find("->") != std::string::npos) {
-        cArray<std::string> parts = Parse_Sausage_Text(token.token, "->");
-        if (parts.Count() == 2) { // List
-          std::string name = parts[0];
-          std::string var = parts[1];
-          if (this->lists.Does_Key_Exist(name)) {
-            if (this->vars.Does_Key_Exist(var)) {
-              int index = this->vars[var];
-              value = this->lists[name][index];
-            }
-            else {
-              this->Generate_Parse_Error("Could not find index variable for list.", token);
-            }
-          }
-          else {
-            this->Generate_Parse_Error("Could not find list " + name + ".", token);
-          }
-        }
-        else if (parts.Count() == 3) { // Matrix
-          std::string name = parts[0];
-          std::string var_y = parts[1];
-          std::string var_x = parts[2];
-          if (this->matrices.Does_Key_Exist(name)) {
-            if (this->vars.Does_Key_Exist(var_y)) {
-              if (this->vars.Does_Key_Exist(var_x)) {
-                int y = this->vars[var_y];
-                int x = this->vars[var_x];
-                value = this->matrices[name][y][x];
-              }
-              else {
-                this->Generate_Parse_Error("Could not find x variable for matrix.", token);
-              }
-            }
-            else {
-              this->Generate_Parse_Error("Could not find y variable for matrix.", token);
-            }
-          }
-          else {
-            this->Generate_Parse_Error("Could not find matrix " + name + ".", token);
-          }
-        }
-        else {
-          this->Generate_Parse_Error("Invalid dimension type.", token);
-        }
-      }
-      else {
-        if (this->vars.Does_Key_Exist(token.token)) {
-          value = this->vars[token.token];
-        }
-        else if (this->symtab.Does_Key_Exist(token.token)) {
-          value = this->symtab[token.token];
-        }
-        else {
-          this->Generate_Parse_Error("Symbol " + token.token + " was not found.", token);
-        }
-      }
+  cFlat_Matrix::cFlat_Matrix(const cFlat_Matrix& other) {
+    this->width = other.width;
+    this->height = other.height;
+    this->data.assign(other.cells, other.cells + (other.width * other.height));
+    this->cells = this->data.data();
+  }
+
+  /**
+   * Copies a matrix. A copy of a mapped matrix gets its own buffer.
+   * @param other The matrix to copy.
+   * @return This matrix.
+   */
+  cFlat_Matrix& cFlat_Matrix::operator=(const cFlat_Matrix& other) {
+    if (this != &other) {
+      std::vector<int> data(other.cells, other.cells + (other.width * other.height));
+      this->data.swap(data);
+      this->mapping.reset();
+      this->width = other.width;
+      this->height = other.height;
+      this->cells = this->data.data();
     }
-    return value;
+    return *this;
   }
 
   /**
-   * Determines if a token is an operator.
-   * @param token The token to check.
-   * @return True if the token is an operator, false otherwise.
+   * Gets the number of cells.
+   * @return The number of cells.
    */
-  bool cSource::Is_Operator(sToken& token) {
-    return ((token.token == "+") ||
-            (token.token == "-") ||
-            (token.token == "*") ||
-            (token.token == "/") ||
-            (token.token == "rem") ||
-            (token.token == "rand") ||
-            (token.token == "cos") ||
-            (token.token == "sin"));
+  int cFlat_Matrix::Count() {
+    return this->width * this->height;
   }
 
   /**
-   * Finds the end token in the block.
-   * @throws An error if something is missing.
+   * Gets a row of the matrix.
+   * @param y The row.
+   * @return The values in the row.
    */
-  void cSource::Find_End_Token() {
-    int count = this->tokens.Count();
-    bool found = false;
-    while (this->pointer < count) {
-      sToken& token = this->Get_Token();
-      if ((token.token == "end") || (token.token == "else")) {
-        found = true;
-        break; // Jump out!
-      }
-      else if ((token.token == "if") || (token.token == "while") || (token.token == "subroutine") || (token.token == "object") || (token.token == "map")) {
-        this->Find_End_Token();
-      }
-    }
-    if (!found) {
-      throw cError("Could not find end token!");
-    }
+  int* cFlat_Matrix::operator[](int y) {
+    return this->cells + (y * this->width);
   }
 
   /**
-   * Finds a subroutine given the name.
-   * @param name The name of the subroutine.
-   * @throws An error if the subroutine could not be found.
+   * Gets a value without checking the coordinates.
+   * @param x The x coordinate.
+   * @param y The y coordinate.
+   * @return The value.
    */
-  void cSource::Find_Subroutine(std::string name) {
-    int count = this->tokens.Count();
-    bool found = false;
-    while (this->pointer < count) {
-      sToken& token = this->Get_Token();
-      if (token.token == "subroutine") {
-        sToken& sub_name = this->Get_Token();
-        if (sub_name.token == name) {
-          found = true;
-          break;
-        }
-      }
-    }
+  int& cFlat_Matrix::Get(int x, int y) {
+    return this->cells[(y * this->width) + x];
   }
 
   /**
-   * Interprets a single command.
-   * @throws An error if something went wrong.
+   * Gets a value.
+   * @param x The x coordinate.
+   * @param y The y coordinate.
+   * @return The value.
+   * @throws An error if the coordinates are outside the matrix.
    */
-  void cSource::Interpret() {
-    int command_pos = this->pointer;
-    sToken& command = this->Get_Token();
-    if (command.token == "if") {
-      int result = this->Eval_Conditional();
-      this->Check_Keyword("then");
-      if (!result) {
-        this->Find_End_Token();
-      }
+  int& cFlat_Matrix::At(int x, int y) {
+    if ((x < 0) || (x >= this->width) || (y < 0) || (y >= this->height)) {
+      throw cError("Coordinates " + Number_To_Text(x) + ", " + Number_To_Text(y) + " are out of range.");
     }
-    else if (command.token == "else") {
-      this->Find_End_Token();
-    }
-    else if (command.token == "end") {
-      if (this->stack.Count() > 0) {
-        this->pointer = this->stack.Pop(); // Jump to saved position.
+    return this->Get(x, y);
+  }
+
+  /**
+   * Copies the matrix into an I/O matrix of the same size.
+   * @param matrix The I/O matrix.
+   */
+  void cFlat_Matrix::To_Matrix(cMatrix& matrix) {
+    for (int y = 0; y < this->height; y++) {
+      int* row = (*this)[y];
+      for (int x = 0; x < this->width; x++) {
+        matrix[y][x] = row[x];
       }
     }
-    else if (command.token == "while") {
-      int result = this->Eval_Conditional();
-      this->Check_Keyword("do");
-      if (result) {
-        this->stack.Push(command_pos); // Save start position of while.
-      }
-      else {
-        this->Find_End_Token();
+  }
+
+  /**
+   * Copies an I/O matrix of the same size into the matrix.
+   * @param matrix The I/O matrix.
+   */
+  void cFlat_Matrix::From_Matrix(cMatrix& matrix) {
+    for (int y = 0; y < this->height; y++) {
+      int* row = (*this)[y];
+      for (int x = 0; x < this->width; x++) {
+        row[x] = matrix[y][x];
       }
     }
-    else if (command.token == "subroutine") {
-      this->Find_End_Token(); // We jump over subroutines.
-    }
-    else if (command.token == "call") {
-      sToken& name = this->Get_Token();
-      this->stack.Push(this->pointer); // Save the return address.
-      this->Find_Subroutine(name.token);
-    }
-    else if (command.token == "store") {
-      int result = this->Eval_Expression();
-      this->Check_Keyword("in");
-      sToken& location = this->Get_Token();
-      this->Store(result, location);
-    }
-    else if (command.token == "output") {
-      sToken& name = this->Get_Token();
-      this->Check_Keyword("at");
-      int x = this->Eval_Expression();
-      int y = this->Eval_Expression();
-      this->Check_Keyword("color");
-      int red = this->Eval_Expression();
-      int green = this->Eval_Expression();
-      int blue = this->Eval_Expression();
-      if (this->strings.Does_Key_Exist(name.token)) {
-        this->io->Output_Text(this->strings[name.token], x, y, red, green, blue);
-      }
-      else {
-        this->Generate_Parse_Error("String " + name.token + " was not found.", name);
-      }
+  }
+
+  /**
+   * Checks whether a file holds a binary map.
+   * @param name The name of the file.
+   * @return True if the file starts with the binary map signature.
+   */
+  bool cFlat_Matrix::Is_Binary(std::string name) {
+    std::ifstream file(name.c_str(), std::ios::binary);
+    char signature[4] = { 0, 0, 0, 0 };
+    file.read(signature, 4);
+    return file && (std::memcmp(signature, MAP_SIGNATURE, 4) == 0);
+  }
+
+  /**
+   * Uses a binary map as the storage of the matrix. The file is mapped copy
+   * on write so the script can change the matrix without changing the file.
+   * @param name The name of the file.
+   * @throws An error if the map is not valid.
+   */
+  void cFlat_Matrix::Map_Binary(std::string name) {
+    std::shared_ptr<cMapped_File> mapping(new cMapped_File(name));
+    sMap_Header header = Check_Map_Header(name, mapping->data, mapping->size);
+    std::vector<int>().swap(this->data);
+    this->mapping = mapping;
+    this->width = header.width;
+    this->height = header.height;
+    this->cells = (int*)(mapping->data + sizeof(sMap_Header));
+  }
+
+  /**
+   * Loads a window of a binary map into the matrix, keeping the size of the
+   * matrix. Only the rows in the window are read. Cells past the edge of the
+   * map are set to zero.
+   * @param name The name of the file.
+   * @param left The left of the window in the map.
+   * @param top The top of the window in the map.
+   * @throws An error if the map is not valid.
+   */
+  void cFlat_Matrix::Load_Binary_Window(std::string name, int left, int top) {
+    cMapped_File mapping(name);
+    sMap_Header header = Check_Map_Header(name, mapping.data, mapping.size);
+    const int* map = (const int*)(mapping.data + sizeof(sMap_Header));
+    if (this->mapping) { // Stop sharing the old map before writing.
+      *this = cFlat_Matrix(this->width, this->height);
     }
-    else if (command.token == "number") {
-      sToken& name = this->Get_Token();
-      this->Check_Keyword("at");
-      int x = this->Eval_Expression();
-      int y = this->Eval_Expression();
-      this->Check_Keyword("color");
-      int red = this->Eval_Expression();
-      int green = this->Eval_Expression();
-      int blue = this->Eval_Expression();
-      if (this->vars.Does_Key_Exist(name.token)) {
-        this->io->Output_Text(Number_To_Text(this->vars[name.token]), x, y, red, green, blue);
-      }
-      else {
-        this->Generate_Parse_Error("String " + name.token + " was not found.", name);
+    for (int y = 0; y < this->height; y++) {
+      int* row = (*this)[y];
+      int map_y = top + y;
+      for (int x = 0; x < this->width; x++) {
+        int map_x = left + x;
+        bool inside = (map_x >= 0) && (map_x < header.width) && (map_y >= 0) && (map_y < header.height);
+        row[x] = inside ? map[(map_y * header.width) + map_x] : 0;
       }
     }
-    else if (command.token == "define") {
-      sToken& name = this->Get_Token();
-      this->Check_Keyword("as");
-      sToken& value = this->Get_Token();
-      this->symtab[name.token] = Text_To_Number(value.token);
-    }
-    else if (command.token == "object") {
-      sToken& name = this->Get_Token();
-      this->Check_Keyword("as");
-      sToken value = this->Get_Token();
-      int index = 0;
-      while (value.token != "end") {
-        this->symtab[name.token + ":" + value.token] = index++;
-      }
+  }
+
+  /**
+   * Saves the matrix as a binary map.
+   * @param name The name of the file.
+   * @throws An error if the file could not be written.
+   */
+  void cFlat_Matrix::Save_Binary(std::string name) {
+    sMap_Header header;
+    std::memcpy(header.signature, MAP_SIGNATURE, 4);
+    header.version = eMAP_VERSION;
+    header.width = this->width;
+    header.height = this->height;
+    std::vector<int> cells(this->cells, this->cells + this->Count()); // The file may be our own mapping.
+    std::string temp_name = name + ".tmp"; // Mapped readers keep the old file until they let go.
+    std::ofstream file(temp_name.c_str(), std::ios::binary | std::ios::trunc);
+    file.write((const char*)&header, sizeof(sMap_Header));
+    file.write((const char*)cells.data(), cells.size() * sizeof(int));
+    file.close();
+    if (!file || !Replace_File(temp_name, name)) {
+      std::remove(temp_name.c_str());
+      throw cError("Could not save map " + name + ".");
     }
-    else if (command.token == "map") {
-      sToken value = this->Get_Token();
-      int index = 0;
-      while (value.token != "end") {
-        this->symtab[value.token] = index++;
-      }
+    this->mapping.reset();
+    this->data.swap(cells);
+    this->cells = this->data.data();
+  }
+
+  /**
+   * Checks that a mapped file holds a map this version can read.
+   * @param name The name of the file.
+   * @param data The mapped file.
+   * @param size The size of the file in bytes.
+   * @return The header of the map.
+   * @throws An error if the map is not valid.
+   */
+  sMap_Header Check_Map_Header(std::string name, const char* data, size_t size) {
+    sMap_Header header;
+    if (size < sizeof(sMap_Header)) {
+      throw cError("Map " + name + " is too short.");
     }
-    else if (command.token == "var") {
-      sToken& name = this->Get_Token();
-      this->vars[name.token] = 0;
+    std::memcpy(&header, data, sizeof(sMap_Header));
+    if (std::memcmp(header.signature, MAP_SIGNATURE, 4) != 0) {
+      throw cError("Map " + name + " is not a binary map.");
     }
-    else if (command.token == "list") {
-      sToken& name = this->Get_Token();
-      this->Check_Keyword("size");
-      int size = this->Eval_Expression();
-      this->lists[name.token] = cList(size);
+    if (header.version != eMAP_VERSION) {
+      throw cError("Map " + name + " has unsupported version " + Number_To_Text(header.version) + ".");
     }
-    else if (command.token == "matrix") {
-      sToken& name = this->Get_Token();
-      this->Check_Keyword("size");
-      int width = this->Eval_Expression();
-      int height = this->Eval_Expression();
-      this->matrices[name.token] = cMatrix(width, height);
+    if ((header.width < 0) || (header.height < 0) ||
+      ((size - sizeof(sMap_Header)) / sizeof(int) < (size_t)header.width * (size_t)header.height)) {
+      throw cError("Map " + name + " is truncated.");
     }
-    else if (command.token == "string") {
-      sToken& name = this->Get_Token();
-      this->Check_Keyword("as");
-      sToken& string = this->Get_Token();
-      this->strings[name.token] = C_Lesh_String_To_Cpp_String(string.token);
+    return header;
+  }
+
+  /**
+   * Checks whether a file name asks for a binary map when saving.
+   * @param name The name of the file.
+   * @return True if the name ends with the binary map extension.
+   */
+  bool Is_Binary_Name(std::string name) {
+    std::string extension = MAP_EXTENSION;
+    return (name.length() >= extension.length()) &&
+      (name.compare(name.length() - extension.length(), extension.length(), extension) == 0);
+  }
+
+  /**
+   * Moves a finished file over another in one step, so nobody sees it
+   * half written.
+   * @param temp_name The name of the finished file.
+   * @param name The name of the file to replace.
+   * @return True if the file was replaced, false otherwise.
+   */
+  bool Replace_File(std::string temp_name, std::string name) {
+#ifdef _WIN32
+    return MoveFileExA(temp_name.c_str(), name.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(temp_name.c_str(), name.c_str()) == 0;
+#endif
+  }
+
+  // **************************************************************************
+  // Mapped File Implementation
+  // **************************************************************************
+
+  /**
+   * Maps a whole file into memory, copy on write.
+   * @param name The name of the file.
+   * @throws An error if the file could not be mapped.
+   */
+  cMapped_File::cMapped_File(std::string name) {
+    this->data = NULL;
+    this->size = 0;
+#ifdef _WIN32
+    this->file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (this->file == INVALID_HANDLE_VALUE) {
+      throw cError("Could not open map " + name + ".");
     }
-    else if (command.token == "load") {
-      sToken& name = this->Get_Token();
-      this->Check_Keyword("from");
-      sToken& file = this->Get_Token();
-      if (this->matrices.Does_Key_Exist(name.token)) {
-        this->io->Load(C_Lesh_String_To_Cpp_String(file.token), this->matrices[name.token]);
-      }
-      else {
-        this->Generate_Parse_Error("Matrix " + name.token + " does not exist.", name);
-      }
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(this->file, &file_size);
+    this->size = (size_t)file_size.QuadPart;
+    this->view = CreateFileMappingA(this->file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (this->view) {
+      this->data = (char*)MapViewOfFile(this->view, FILE_MAP_COPY, 0, 0, 0);
     }
-    else if (command.token == "save") {
-      sToken& file = this->Get_Token();
-      this->Check_Keyword("to");
-      sToken& name = this->Get_Token();
-      if (this->matrices.Does_Key_Exist(name.token)) {
-        this->io->Save(C_Lesh_String_To_Cpp_String(file.token), this->matrices[name.token]);
-      }
-      else {
-        this->Generate_Parse_Error("Matrix " + name.token + " does not exist.", name);
+    if (!this->data) {
+      if (this->view) {
+        CloseHandle(this->view);
       }
+      CloseHandle(this->file);
+      throw cError("Could not map " + name + ".");
     }
-    else if (command.token == "draw") {
-      sToken& name = this->Get_Token();
-      this->Check_Keyword("at");
-      int x = this->Eval_Expression();
-      int y = this->Eval_Expression();
-      int width = this->Eval_Expression();
-      int height = this->Eval_Expression();
-      this->Check_Keyword("angle");
-      int angle = this->Eval_Expression();
-      this->Check_Keyword("flip");
-      int flip_x = this->Eval_Expression();
-      int flip_y = this->Eval_Expression();
-      this->io->Draw_Image(name.token, x, y, width, height, angle, (bool)flip_x, (bool)flip_y);
-    }
-    else if (command.token == "sound") {
-      sToken& name = this->Get_Token();
-      this->io->Play_Sound(name.token);
-    }
-    else if (command.token == "music") {
-      sToken& name = this->Get_Token();
-      this->io->Play_Music(name.token);
-    }
-    else if (command.token == "silence") {
-      this->io->Silence();
-    }
-    else if (command.token == "refresh") {
-      this->io->Refresh();
-    }
-    else if (command.token == "color") {
-      int red = this->Eval_Expression();
-      int green = this->Eval_Expression();
-      int blue = this->Eval_Expression();
-      this->io->Color(red, green, blue);
+#else
+    int file = open(name.c_str(), O_RDONLY);
+    if (file == -1) {
+      throw cError("Could not open map " + name + ".");
     }
-    else if (command.token == "getkey") {
-      sSignal signal = this->io->Read_Signal();
-      sToken& location = this->Get_Token();
-      this->Store(signal.code, location);
+    struct stat info;
+    if (fstat(file, &info) == 0) {
+      this->size = (size_t)info.st_size;
+      void* data = mmap(NULL, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+      this->data = (data != MAP_FAILED) ? (char*)data : NULL;
     }
-    else if (command.token == "stop") {
-      this->status = eSTATUS_DONE;
+    close(file); // The mapping keeps its own reference.
+    if (!this->data) {
+      throw cError("Could not map " + name + ".");
     }
-    else {
-      this->Generate_Parse_Error("Invalid command " + command.token + ".", command);
+#endif
+  }
+
+  /**
+   * Unmaps the file.
+   */
+  cMapped_File::~cMapped_File() {
+#ifdef _WIN32
+    UnmapViewOfFile(this->data);
+    CloseHandle(this->view);
+    CloseHandle(this->file);
+#else
+    munmap(this->data, this->size);
+#endif
+  }
+
+  // **************************************************************************
+  // Slot Table Implementation
+  // **************************************************************************
+
+  /**
+   * Resolves a name to its slot. New names get the next free slot.
+   * @param name The name to resolve.
+   * @param token The index of the token which first used the name.
+   * @return The slot of the name.
+   */
+  int cSlot_Table::Resolve(std::string name, int token) {
+    if (!this->slots.Does_Key_Exist(name)) {
+      this->slots[name] = this->names.Count();
+      this->names.Add(name);
+      this->tokens.Add(token);
+      this->declared.Add(0);
     }
+    return this->slots[name];
   }
 
   /**
-   * Stores a value at a location.
-   * @param number The number to store.
-   * @param location The location to store at.
-   * @throws An error if the location is invalid.
+   * Marks a slot as declared.
+   * @param slot The slot to declare.
    */
-  void cSource::Store(int number, sToken& location) {
-    if (location.token.find("->") != std::string::npos) {
-      cArray<std::string> parts = Parse_Sausage_Text(location.token, "->");
-      if (parts.Count() == 2) { // List
-        std::string name = parts[0];
-        std::string var = parts[1];
-        if (this->lists.Does_Key_Exist(name)) {
-          if (this->vars.Does_Key_Exist(var)) {
-            int index = this->vars[var];
-            this->lists[name][index] = number;
-          }
-          else {
-            this->Generate_Parse_Error("Could not find index variable for list.", location);
-          }
-        }
-        else {
-          this->Generate_Parse_Error("Could not find list " + name + ".", location);
-        }
-      }
-      else if (parts.Count() == 3) { // Matrix
-        std::string name = parts[0];
-        std::string var_y = parts[1];
-        std::string var_x = parts[2];
-        if (this->matrices.Does_Key_Exist(name)) {
-          if (this->vars.Does_Key_Exist(var_y)) {
-            if (this->vars.Does_Key_Exist(var_x)) {
-              int y = this->vars[var_y];
-              int x = this->vars[var_x];
-              this->matrices[name][y][x] = number;
-            }
-            else {
-              this->Generate_Parse_Error("Could not find x variable for matrix.", location);
-            }
-          }
-          else {
-            this->Generate_Parse_Error("Could not find y variable for matrix.", location);
-          }
-        }
-        else {
-          this->Generate_Parse_Error("Could not find matrix " + name + ".", location);
-        }
-      }
-      else {
-        this->Generate_Parse_Error("Invalid dimension type.", location);
-      }
+  void cSlot_Table::Declare(int slot) {
+    this->declared[slot] = 1;
+  }
+
+  /**
+   * Finds the slot of a name.
+   * @param name The name to find.
+   * @return The slot or -1 if the name was never used.
+   */
+  int cSlot_Table::Find(std::string name) {
+    int slot = -1;
+    if (this->slots.Does_Key_Exist(name)) {
+      slot = this->slots[name];
     }
-    else {
-      if (this->vars.Does_Key_Exist(location.token)) {
-        this->vars[location.token] = number;
-      }
-      else if (this->symtab.Does_Key_Exist(location.token)) {
-        this->symtab[location.token] = number;
-      }
-      else {
-        this->Generate_Parse_Error("Symbol " + location.token + " was not found.", location);
-      }
+    return slot;
+  }
+
+  /**
+   * Gets the number of slots.
+   * @return The number of slots.
+   */
+  int cSlot_Table::Count() {
+    return this->names.Count();
+  }
+
+  // **************************************************************************
+  // Text Pool Implementation
+  // **************************************************************************
+
+  /**
+   * Adds a text to the pool unless it is there already.
+   * @param text The text to add.
+   * @return The ID of the text.
+   */
+  int cText_Pool::Intern(std::string text) {
+    if (!this->ids.Does_Key_Exist(text)) {
+      this->ids[text] = (int)this->texts.size();
+      this->texts.push_back(text);
     }
+    return this->ids[text];
+  }
+
+  /**
+   * Gets a text by its ID.
+   * @param id The ID of the text.
+   * @return The text.
+   */
+  std::string& cText_Pool::operator[](int id) {
+    return this->texts[id];
+  }
+
+  /**
+   * Gets the number of texts in the pool.
+   * @return The number of texts.
+   */
+  int cText_Pool::Count() {
+    return (int)this->texts.size();
   }
 
 }
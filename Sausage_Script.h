@@ -5,40 +5,857 @@
 
 #include "..\Code_Helper\Codeloader.hpp"
 #include "..\Code_Helper\Allegro.hpp"
+#include <allegro5/allegro_memfile.h>
+#include <allegro5/allegro_font.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <climits>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+
+// List and matrix indices are checked in debug builds. Define
+// SAUSAGE_CHECK_BOUNDS to check them in a release build as well.
+#if !defined(NDEBUG) && !defined(SAUSAGE_CHECK_BOUNDS)
+#define SAUSAGE_CHECK_BOUNDS
+#endif
 
 namespace Codeloader {
 
+  enum eOpcode {
+    eOPCODE_PUSH_CONST,
+    eOPCODE_PUSH_VAR,
+    eOPCODE_PUSH_LIST,
+    eOPCODE_PUSH_MATRIX,
+    eOPCODE_GETKEY,
+    eOPCODE_ADD,
+    eOPCODE_SUBTRACT,
+    eOPCODE_MULTIPLY,
+    eOPCODE_DIVIDE,
+    eOPCODE_REMAINDER,
+    eOPCODE_RANDOM,
+    eOPCODE_COSINE,
+    eOPCODE_SINE,
+    eOPCODE_EQUAL,
+    eOPCODE_NOT_EQUAL,
+    eOPCODE_GREATER,
+    eOPCODE_LESS,
+    eOPCODE_GREATER_OR_EQUAL,
+    eOPCODE_LESS_OR_EQUAL,
+    eOPCODE_AND,
+    eOPCODE_OR,
+    eOPCODE_IF,
+    eOPCODE_ELSE,
+    eOPCODE_END,
+    eOPCODE_WHILE,
+    eOPCODE_SUBROUTINE,
+    eOPCODE_CALL,
+    eOPCODE_STORE_VAR,
+    eOPCODE_STORE_LIST,
+    eOPCODE_STORE_MATRIX,
+    eOPCODE_OUTPUT,
+    eOPCODE_NUMBER,
+    eOPCODE_DEFINE,
+    eOPCODE_VAR,
+    eOPCODE_LIST,
+    eOPCODE_MATRIX,
+    eOPCODE_STRING,
+    eOPCODE_LOAD,
+    eOPCODE_LOAD_WINDOW,
+    eOPCODE_SAVE,
+    eOPCODE_DRAW,
+    eOPCODE_SOUND,
+    eOPCODE_MUSIC,
+    eOPCODE_SILENCE,
+    eOPCODE_REFRESH,
+    eOPCODE_COLOR,
+    eOPCODE_STOP,
+    eOPCODE_FILL,
+    eOPCODE_COPY,
+    eOPCODE_BLIT,
+    eOPCODE_ADD_TO,
+    eOPCODE_MULTIPLY_BY,
+    eOPCODE_SUM,
+    eOPCODE_MINIMUM,
+    eOPCODE_MAXIMUM,
+    eOPCODE_YIELD,
+    eOPCODE_WAIT,
+    eOPCODE_WAITKEY,
+    eOPCODE_PROGRESS,
+    eOPCODE_STEP,
+    eOPCODE_IF_CONST,
+    eOPCODE_WHILE_CONST,
+    eOPCODE_WHILE_VARS,
+    eOPCODE_SNAPSHOT,
+    eOPCODE_RESTORE,
+    eOPCODE_COLLIDE,
+    eOPCODE_NEAREST,
+    eOPCODE_EXIT,
+    eOPCODE_COUNT
+  };
+
+  enum eToken_Kind {
+    eTOKEN_NUMBER,
+    eTOKEN_NAME,
+    eTOKEN_ACCESSOR,
+    eTOKEN_KEYWORD,
+    eTOKEN_OPERATOR,
+    eTOKEN_STRING
+  };
+
+  // Texts are IDs in the text pool of the program so tokens stay small.
+  struct sScript_Token {
+    int text;
+    int kind;
+    int value;
+    int line_no;
+    int source;
+  };
+
+  struct sOpcode_Info {
+    const char* name;
+    int operand_count;
+  };
+
+  enum eContainer {
+    eCONTAINER_LIST,
+    eCONTAINER_MATRIX
+  };
+
+  enum eOption {
+    eOPTION_LEFT_TO_RIGHT = 0x1,
+    eOPTION_PROFILE = 0x2,
+    eOPTION_NO_FUSE = 0x4,
+    eOPTION_RETAINED = 0x8,
+    eCOMPILE_OPTIONS = eOPTION_LEFT_TO_RIGHT | eOPTION_NO_FUSE // Options which change the code.
+  };
+
+  enum eCache_Format {
+    eCACHE_VERSION = 2 // Bump when the compiled form changes.
+  };
+
+  static const char CACHE_SIGNATURE[] = "SSSC";
+
+  enum eSnapshot_Format {
+    eSNAPSHOT_VERSION = 2,
+    eSNAPSHOT_SAME = -1 // Written in place of a container which did not change.
+  };
+
+  static const char SNAPSHOT_SIGNATURE[] = "SSSN";
+
+  // The containers as of the last incremental snapshot.
+  struct sSnapshot_Base {
+    bool valid;
+    std::vector<std::vector<int> > lists;
+    std::vector<std::vector<int> > cells;
+    std::vector<std::string> strings;
+  };
+
+  struct sNode {
+    int opcode;
+    int operands[3];
+    int left;
+    int right;
+    int token;
+  };
+
+  struct sSymbol_Info {
+    int defines;
+    int writes;
+    int value;
+  };
+
+  enum eSuspend {
+    eSUSPEND_NONE,
+    eSUSPEND_FRAME,
+    eSUSPEND_TIME,
+    eSUSPEND_INPUT
+  };
+
+  enum eSignal_Mode {
+    eSIGNALS_LIVE,
+    eSIGNALS_RECORD,
+    eSIGNALS_REPLAY
+  };
+
+  // A signal read by the script and the frame, counted in refreshes, it
+  // was read in.
+  struct sSignal_Entry {
+    int frame;
+    int code;
+  };
+
+  enum eScheduler {
+    eCLOCK_CHECKS = 16, // Clock reads per slice.
+    eMIN_BUDGET = 256,
+    eMAX_BUDGET = 0x4000000,
+    eOVERRUN_TOLERANCE = 10 // Overruns past a tenth of the slice are counted.
+  };
+
+  struct sRun_Stats {
+    int budget;
+    int frames;
+    long long instructions;
+    int frame_instructions;
+    int overruns;
+    int max_overrun;
+  };
+
+  struct sProfile_Entry {
+    long long count;
+    long long nanos;
+  };
+
+  struct sDraw {
+    int image;
+    int x;
+    int y;
+    int width;
+    int height;
+    int angle;
+    int flip_x;
+    int flip_y;
+    int batch;
+  };
+
+  struct sDraw_Batch {
+    int image;
+    int left;
+    int top;
+    int right;
+    int bottom;
+    int count;
+  };
+
+  struct sFuse_Stats {
+    int steps;
+    int if_tests;
+    int loop_tests;
+  };
+
+  struct sDraw_Stats {
+    int frames;
+    int frame_draw_calls;
+    int frame_batches;
+    long long draw_calls;
+    long long batches;
+    int skipped_frames;
+    int partial_frames;
+  };
+
+  enum eDisplay_Item {
+    eDISPLAY_DRAW,
+    eDISPLAY_TEXT,
+    eDISPLAY_COLOR
+  };
+
+  enum eRetained {
+    eTEXT_BAND_HEIGHT = 32, // Glyph sizes belong to the I/O control, so text is a band across the screen.
+    eSCREEN_EDGE = 0x3FFFFFFF // Past any screen. Regions are clipped to the screen by the I/O control.
+  };
+
+  // A command of a retained frame and the area of the screen it covers.
+  struct sDisplay_Item {
+    int type;
+    int image;
+    std::string text;
+    int values[7];
+    int left;
+    int top;
+    int right;
+    int bottom;
+  };
+
+  // Binary maps start with this header followed by the cells row after row
+  // as native ints.
+  struct sMap_Header {
+    char signature[4];
+    int version;
+    int width;
+    int height;
+  };
+
+  enum eMap_Format {
+    eMAP_VERSION = 1
+  };
+
+  static const char MAP_SIGNATURE[] = "SSMX";
+  static const char MAP_EXTENSION[] = ".smx";
+
+  enum eIO_Command {
+    eIO_TEXT,
+    eIO_DRAW,
+    eIO_SOUND,
+    eIO_MUSIC,
+    eIO_SILENCE,
+    eIO_COLOR
+  };
+
+  struct sIO_Command {
+    int type;
+    std::string text;
+    int values[7];
+  };
+
+  struct sBlock {
+    int opcode;
+    int fixup;
+    int token;
+  };
+
+  struct sFixup {
+    int position;
+    int token;
+  };
+
+  int Next_Random(unsigned int& seed, int low, int high);
+  bool Compare_Values(int test, int left, int right);
+  bool Decode_Number(std::string text, int& number);
+  bool Read_Text_File(std::string name, std::string& text);
+  unsigned long long Hash_Text(const std::string& text, int options);
+  void Write_Number(std::ostream& file, int number);
+  int Read_Number(std::istream& file);
+  void Write_Text(std::ostream& file, const std::string& text);
+  std::string Read_Text(std::istream& file);
+  void Get_Draw_Bounds(const int* values, int& left, int& top, int& right, int& bottom);
+  void Write_Changed(std::ostream& file, const int* values, int count, std::vector<int>& base, bool incremental);
+  bool Read_Changed(std::istream& file, std::vector<int>& values);
+  void Write_Numbers(std::ostream& file, const std::vector<int>& numbers);
+  void Read_Numbers(std::istream& file, std::vector<int>& numbers);
+  void Fill_Values(int* values, int count, int value);
+  void Add_Values(int* values, int count, int value);
+  void Multiply_Values(int* values, int count, int value);
+  int Sum_Values(const int* values, int count);
+  int Minimum_Value(const int* values, int count, int least);
+  int Maximum_Value(const int* values, int count, int greatest);
+
+  class cSlot_Table {
+
+    public:
+      cHash<std::string, int> slots;
+      cArray<std::string> names;
+      cArray<int> tokens;
+      cArray<int> declared;
+
+      int Resolve(std::string name, int token);
+      void Declare(int slot);
+      int Find(std::string name);
+      int Count();
+
+  };
+
+  class cText_Pool {
+
+    public:
+      std::deque<std::string> texts; // Grows without moving the texts.
+      cHash<std::string, int> ids;
+
+      int Intern(std::string text);
+      std::string& operator[](int id);
+      int Count();
+
+  };
+
+  class cProfile_Table {
+
+    public:
+      cHash<std::string, int> ids;
+      cArray<std::string> names;
+      std::vector<sProfile_Entry> entries;
+
+      int Get_Id(std::string name);
+      void Charge(int id, long long nanos);
+      void Write(std::ostream& output, std::string title);
+
+  };
+
+  sMap_Header Check_Map_Header(std::string name, const char* data, size_t size);
+  bool Is_Binary_Name(std::string name);
+  bool Replace_File(std::string temp_name, std::string name);
+
+  class cMapped_File {
+
+    public:
+      char* data;
+      size_t size;
+#ifdef _WIN32
+      void* file;
+      void* view;
+#endif
+
+      cMapped_File(std::string name);
+      ~cMapped_File();
+
+  };
+
+  class cFlat_Matrix {
+
+    public:
+      std::vector<int> data;
+      std::shared_ptr<cMapped_File> mapping;
+      int* cells;
+      int width;
+      int height;
+
+      cFlat_Matrix();
+      cFlat_Matrix(int width, int height);
+      cFlat_Matrix(const cFlat_Matrix& other);
+      cFlat_Matrix& operator=(const cFlat_Matrix& other);
+      int Count();
+      int* operator[](int y);
+      int& Get(int x, int y);
+      int& At(int x, int y);
+      void To_Matrix(cMatrix& matrix);
+      void From_Matrix(cMatrix& matrix);
+      static bool Is_Binary(std::string name);
+      void Map_Binary(std::string name);
+      void Load_Binary_Window(std::string name, int left, int top);
+      void Save_Binary(std::string name);
+
+  };
+
+  class cProfiler;
+
+  class cBatch_Control {
+
+    public:
+      virtual ~cBatch_Control() {}
+      virtual void Begin_Batch() = 0;
+      virtual void End_Batch() = 0;
+
+  };
+
+  // The layout of an object record for collisions. Records follow each
+  // other in a list or are the rows of a matrix.
+  enum eRecord {
+    eRECORD_X,
+    eRECORD_Y,
+    eRECORD_WIDTH,
+    eRECORD_HEIGHT,
+    eRECORD_SIZE
+  };
+
+  enum eGrid {
+    eGRID_EDGE = 0x3FFFFFFF // Cells past the edge are folded into it.
+  };
+
+  // An object filed in one cell of a spatial grid.
+  struct sGrid_Entry {
+    int object;
+    int cell_x;
+    int cell_y;
+    int next;
+  };
+
+  class cSpatial_Grid {
+
+    public:
+      int cell_size;
+      std::vector<int> heads;
+      std::vector<sGrid_Entry> entries;
+      std::vector<int> pairs;
+
+      cSpatial_Grid();
+      void Reset(int cell_size, int object_count);
+      void Insert(int object, long long left, long long top, long long right, long long bottom);
+      int Get_Cell(long long coordinate);
+      int Find_Bucket(int cell_x, int cell_y);
+
+  };
+
+  class cRegion_Control {
+
+    public:
+      virtual ~cRegion_Control() {}
+      virtual bool Begin_Region(int left, int top, int right, int bottom) = 0;
+      virtual void End_Region() = 0;
+
+  };
+
+  class cResource_Control {
+
+    public:
+      virtual ~cResource_Control() {}
+      virtual int Get_Load_Progress() = 0;
+
+  };
+
   class cSource {
 
     public:
-      cArray<sToken> tokens;
-      cHash<std::string, int> vars;
-      cHash<std::string, cList> lists;
-      cHash<std::string, cMatrix> matrices;
-      cHash<std::string, std::string> strings;
+      cArray<sScript_Token> tokens;
+      std::vector<int> code;
+      std::vector<int> code_tokens;
+      std::vector<int> statement_tokens;
+      cText_Pool texts;
+      cSlot_Table var_table;
+      cSlot_Table list_table;
+      cSlot_Table matrix_table;
+      cSlot_Table string_table;
+      std::vector<int> vars;
+      std::vector<int> var_presets;
+      std::vector<std::vector<int> > lists;
+      std::vector<cFlat_Matrix> matrices;
+      std::vector<std::string> strings;
       cArray<int> stack;
-      cHash<std::string, int> symtab;
+      cArray<sBlock> blocks;
+      cHash<std::string, int> subroutines;
+      cArray<sFixup> calls;
+      std::vector<sNode> nodes;
+      std::vector<sSymbol_Info> symbols;
+      bool fold_symbols;
+      sRun_Stats run_stats;
+      sSnapshot_Base snapshot_base;
+      unsigned int random_seed;
+      int signal_mode;
+      std::vector<sSignal_Entry> signal_log;
+      int signal_index;
+      unsigned int log_seed;
+      int log_frames;
+      cProfiler* profiler;
+      std::string file_suffix;
+      std::vector<sDraw> draws;
+      std::vector<sDraw_Batch> batches;
+      std::vector<int> draw_order;
+      sDraw_Stats draw_stats;
+      cBatch_Control* batch_io;
+      cResource_Control* resource_io;
+      cRegion_Control* region_io;
+      std::vector<sDisplay_Item> display_list;
+      std::vector<sDisplay_Item> shown_list;
+      cSpatial_Grid grid;
       int pointer;
+      int cursor;
+      int options;
       int status;
+      bool from_cache;
+      int suspend;
+      std::chrono::steady_clock::time_point wake_time;
       cIO_Control* io;
 
-      cSource(std::string source, cIO_Control* io);
+      cSource(std::string source, cIO_Control* io, int options);
+      ~cSource();
       void Parse_Tokens(std::string source);
-      void Generate_Parse_Error(std::string message, sToken token);
+      void Classify_Token(sScript_Token& token);
+      void Generate_Parse_Error(std::string message, sScript_Token& token);
+      std::string& Get_Text(sScript_Token& token);
       void Run(int timeout);
-      sToken& Get_Token();
-      sToken& Peek_Token();
+      void Run_Steps(int steps);
+      bool Resume();
+      int Get_Sleep_Time();
+      void Update_Budget(int count, int micros, int timeout);
+      sScript_Token& Get_Token();
+      sScript_Token& Peek_Token();
+      bool Has_Token();
       void Check_Keyword(std::string keyword);
-      int Eval_Expression();
-      bool Eval_Condition();
-      int Eval_Conditional();
-      int Eval_Operand();
-      bool Is_Operator(sToken& token);
-      bool Is_Logic(sToken& token);
-      void Find_End_Token();
-      void Find_Subroutine(std::string name);
+      bool Load_Cache(std::string source, unsigned long long hash);
+      bool Read_Cache_Header(std::istream& cache, unsigned long long hash);
+      void Save_Cache(std::string source, unsigned long long hash);
+      void Read_Slots(std::istream& cache, cSlot_Table& table);
+      void Write_Slots(std::ostream& cache, cSlot_Table& table);
+      void Save_Snapshot(std::ostream& file, bool incremental);
+      bool Load_Snapshot(std::istream& file);
+      unsigned long long Hash_Code();
+      int Read_Signal();
+      void Record_Signals();
+      void Save_Signals(std::string name);
+      bool Replay_Signals(std::string name);
+      int Next_Signal_Frame();
+      void Compile();
+      void Allocate_Storage();
+      void Compile_Pass();
+      void Resolve_Calls();
+      void Check_Slots(cSlot_Table& table, std::string message);
+      void Compile_Statement();
+      int Compile_Name(cSlot_Table& table, bool declare);
+      int Parse_Operand();
+      int Compile_Container(int& slot);
+      void Compile_Location();
+      int Make_Accessor(int index, int list_opcode, int matrix_opcode);
+      void Compile_Expression();
+      int Parse_Expression(int level);
+      int Parse_Condition();
+      int Parse_Conditional(int level);
+      void Compile_Conditional(int opcode, int const_opcode, int vars_opcode);
+      bool Fuse_Test(int opcode, int test, int right_opcode);
+      bool Fuse_Step(int node_index);
+      sFuse_Stats Count_Fusions();
+      int Get_Level(int opcode);
+      int Make_Leaf(int opcode, int token, int operand_1, int operand_2, int operand_3);
+      int Make_Node(int opcode, int left, int right);
+      bool Fold_Operator(int opcode, int left, int right, int& result);
+      void Generate_Node(int node_index);
+      void Note_Symbol(int slot, bool define, int value);
+      bool Is_Constant(int slot);
+      int Get_Operator(sScript_Token& token);
+      int Get_Test(sScript_Token& token);
+      int Get_Logic(sScript_Token& token);
+      void Open_Block(int opcode, int token);
+      void Emit_Word(int word, int token);
+      void Emit(int opcode);
+      void Emit(int opcode, int operand);
+      void Emit(int opcode, int operand_1, int operand_2);
+      void Emit(int opcode, int operand_1, int operand_2, int operand_3);
+      int Add_Text(std::string text);
+      int Get_Token_Index();
       void Interpret();
-      void Store(int number, sToken& location);
+      int Get_Rows(int kind, int slot, int& width);
+      int* Get_Row(int kind, int slot, int row);
+      int* Get_Values(int kind, int slot, int& count);
+      void Apply(int opcode, int kind, int slot, int value);
+      int Reduce(int opcode, int kind, int slot);
+      void Copy(int kind, int source, int dest);
+      void Blit(int source, int dest, int* values);
+      void Queue_Draw(int image, int* values);
+      void Flush_Draws();
+      int* Get_Records(int kind, int slot, int& stride, int& count);
+      int Collide(int kind, int slot, int result);
+      int Find_Nearest(int kind, int slot, int result, int radius);
+      void Retain(int type, int image, std::string text, const int* values, int count);
+      bool Find_Damage(int& left, int& top, int& right, int& bottom);
+      void Present_Display();
+      void Check_Bounds(int index, int size, int position);
+      bool Preset_Var(std::string name, int value);
+      int& Get_Var(std::string name);
+      std::string Get_File_Name(std::string name, bool reading);
+
+  };
+
+  class cProfiler {
+
+    public:
+      cSource* source;
+      cProfile_Table lines;
+      cProfile_Table commands;
+      cProfile_Table subroutines;
+      cProfile_Table stacks;
+      std::vector<int> line_ids;
+      std::vector<int> command_ids;
+      std::vector<std::string> frames;
+      std::vector<int> frame_depths;
+      std::vector<int> subroutine_ids;
+      int stack_id;
+      std::chrono::steady_clock::time_point last_time;
+
+      cProfiler(cSource* source, std::string name);
+      void Resume();
+      void Step();
+      bool Is_Outermost(int frame_index);
+      void Update_Stack();
+      void Write(std::string name);
+
+  };
+
+  enum eStream {
+    eSTREAM_QUEUED,
+    eSTREAM_READ,
+    eSTREAM_DECODED,
+    eSTREAM_FAILED
+  };
+
+  struct sStream_Entry {
+    std::string name;
+    std::string path;
+    std::string bytes;
+    int state;
+  };
+
+  class cResource_Stream {
+
+    public:
+      std::vector<sStream_Entry> entries;
+      cHash<std::string, int> names;
+      std::thread reader;
+      std::mutex lock;
+      std::atomic<int> finished;
+      std::atomic<bool> stopping;
+
+      cResource_Stream();
+      ~cResource_Stream();
+      void Start(std::string name);
+      void Stop();
+      int Find(std::string name);
+      int Get_State(int entry);
+      void Set_State(int entry, int state);
+      int Get_Progress();
+      void Read_Entries();
+
+  };
+
+  enum eText_Cache {
+    eTEXT_CACHE_LIMIT = 256,
+    eATLAS_LIMIT = 16,
+    eATLAS_GLYPHS = 11 // The digits then the minus sign.
+  };
+
+  struct sText_Stats {
+    long long run_hits;
+    long long run_misses;
+    long long digit_hits;
+    long long digit_misses;
+  };
+
+  // Text rendered in one color, kept until it is the least recently used.
+  struct sText_Run {
+    std::string key;
+    ALLEGRO_BITMAP* bitmap;
+    long long last_use;
+  };
+
+  // Pre-rendered digits in one color, composed into numbers which change.
+  struct sDigit_Atlas {
+    std::string key;
+    ALLEGRO_BITMAP* bitmap;
+    long long last_use;
+    int offsets[eATLAS_GLYPHS + 1];
+  };
+
+  class cBatched_Allegro_IO : public cAllegro_IO, public cBatch_Control, public cResource_Control, public cRegion_Control {
+
+    public:
+      cResource_Stream stream;
+      ALLEGRO_BITMAP* canvas;
+      ALLEGRO_BITMAP* screen;
+      cHash<std::string, int> run_ids;
+      std::vector<sText_Run> runs;
+      int run_evictions;
+      cHash<std::string, int> atlas_ids;
+      std::vector<sDigit_Atlas> atlases;
+      int atlas_evictions;
+      long long text_clock;
+      sText_Stats text_stats;
+
+      cBatched_Allegro_IO(std::string title, int width, int height, int scale, std::string font);
+      ~cBatched_Allegro_IO();
+      void Begin_Batch();
+      void End_Batch();
+      bool Begin_Region(int left, int top, int right, int bottom);
+      void End_Region();
+      void Stream_Resources(std::string name);
+      int Get_Load_Progress();
+      void Draw_Image(std::string name, int x, int y, int width, int height, int angle, bool flip_x, bool flip_y);
+      void Play_Sound(std::string name);
+      void Output_Text(std::string text, int x, int y, int red, int green, int blue);
+      ALLEGRO_FILE* Open_Entry(int entry);
+      bool Decode_Image(int entry);
+      bool Decode_Sound(int entry);
+      ALLEGRO_BITMAP* Render_Text(std::string text, int red, int green, int blue);
+      int Find_Run(std::string key);
+      int Find_Atlas(std::string key);
+      void Clear_Text_Cache();
+
+  };
+
+  class cIO_Queue : public cIO_Control, public cResource_Control {
+
+    public:
+      cIO_Control* io;
+      std::mutex* io_lock;
+      std::vector<sIO_Command> commands;
+      unsigned int seed;
+      int signal;
+      bool refresh;
+
+      cIO_Queue(cIO_Control* io, std::mutex* io_lock, unsigned int seed);
+      void Queue(int type, std::string text, const int* values, int count);
+      bool Replay();
+      int Get_Random_Number(int low, int high);
+      void Output_Text(std::string text, int x, int y, int red, int green, int blue);
+      void Load(std::string name, cMatrix& matrix);
+      void Save(std::string name, cMatrix& matrix);
+      void Draw_Image(std::string name, int x, int y, int width, int height, int angle, bool flip_x, bool flip_y);
+      void Play_Sound(std::string name);
+      void Play_Music(std::string name);
+      void Silence();
+      void Refresh();
+      void Color(int red, int green, int blue);
+      sSignal Read_Signal();
+      int Get_Load_Progress();
+
+  };
+
+  class cSource_Pool {
+
+    public:
+      std::vector<cSource*> sources;
+      std::vector<cIO_Queue*> queues;
+      std::vector<std::pair<int, cError> > errors;
+      std::vector<std::thread> threads;
+      std::vector<std::mutex> work_locks;
+      std::vector<std::deque<int> > work;
+      std::mutex frame_lock;
+      std::mutex io_lock;
+      std::condition_variable frame_start;
+      std::condition_variable frame_done;
+      int frame;
+      int busy;
+      bool stopping;
+      int steps;
+      cIO_Control* io;
+
+      cSource_Pool(cIO_Control* io, int thread_count, int steps);
+      ~cSource_Pool();
+      int Add(std::string program, int options);
+      void Run_Frame();
+      void Work(int worker);
+      void Run_Work(int worker);
+      int Take_Work(int worker);
+      bool Is_Done();
+
+  };
+
+  enum eGolden_Test {
+    eCACHE_TEST_RUNS = 5
+  };
+
+  // A script run headless whose calls must match a file of expected calls.
+  struct sGolden_Test {
+    const char* program;
+    const char* signals;
+    const char* expected;
+    int options;
+    bool slices; // Records the start of each host slice too.
+  };
+
+  class cHeadless_IO : public cIO_Control, public cRegion_Control {
+
+    public:
+      cArray<std::string> calls;
+      std::vector<int> signals;
+      int signal_index;
+      unsigned int seed;
+      bool record;
+      int draw_count;
+      int text_count;
+      int sound_count;
+      int refresh_count;
+
+      cHeadless_IO(bool record);
+      void Load_Signals(std::string name);
+      bool Has_Signals();
+      void Record(std::string call);
+      int Get_Random_Number(int low, int high);
+      void Output_Text(std::string text, int x, int y, int red, int green, int blue);
+      void Load(std::string name, cMatrix& matrix);
+      void Save(std::string name, cMatrix& matrix);
+      void Draw_Image(std::string name, int x, int y, int width, int height, int angle, bool flip_x, bool flip_y);
+      void Play_Sound(std::string name);
+      void Play_Music(std::string name);
+      void Silence();
+      void Refresh();
+      void Color(int red, int green, int blue);
+      sSignal Read_Signal();
+      bool Begin_Region(int left, int top, int right, int bottom);
+      void End_Region();
 
   };
 